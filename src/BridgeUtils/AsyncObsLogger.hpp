@@ -0,0 +1,212 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "ILogger.hpp"
+#include "ObsLogger.hpp"
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+/**
+ * @brief A logger that hands formatted messages to a background thread which writes them to the OBS log.
+ *
+ * Producers copy the message into a bounded lock-free MPSC ring and return without taking a lock or
+ * calling blog. When the ring is full, the message is dropped and counted; the count is reported by the
+ * background thread. Errors wake the background thread immediately, other messages are flushed within
+ * FLUSH_INTERVAL. Messages longer than MESSAGE_CAPACITY, and every message after shutdown(), are written
+ * synchronously instead. The background thread also reports the counts left on rate-limited sites every
+ * SUPPRESSED_REPORT_INTERVAL, and shutdown() reports them one last time.
+ *
+ * shutdown() must be called before the module is unloaded so that the background thread does not outlive it.
+ */
+class AsyncObsLogger final : public ILogger {
+public:
+	static constexpr std::size_t CAPACITY = 256;
+	static constexpr std::size_t MESSAGE_CAPACITY = 480;
+	static constexpr std::chrono::milliseconds FLUSH_INTERVAL{20};
+	static constexpr std::chrono::seconds SUPPRESSED_REPORT_INTERVAL{60};
+
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+private:
+	struct Cell {
+		std::atomic<std::size_t> sequence;
+		LogLevel level;
+		std::uint16_t length;
+		char text[MESSAGE_CAPACITY];
+	};
+
+	const char *prefix;
+	const std::unique_ptr<Cell[]> cells;
+	alignas(64) mutable std::atomic<std::size_t> enqueuePos = 0;
+	alignas(64) std::size_t dequeuePos = 0;
+	mutable std::atomic<std::uint64_t> droppedCount = 0;
+	std::uint64_t reportedDroppedCount = 0;
+	std::atomic<bool> running = true;
+	mutable std::mutex wakeMtx;
+	mutable std::condition_variable wakeCond;
+	mutable std::mutex syncMtx;
+	std::thread consumer;
+
+public:
+	explicit AsyncObsLogger(const char *_prefix) : prefix(_prefix), cells(std::make_unique<Cell[]>(CAPACITY))
+	{
+		for (std::size_t i = 0; i < CAPACITY; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		consumer = std::thread(&AsyncObsLogger::consumerLoop, this);
+	}
+
+	~AsyncObsLogger() noexcept override { shutdown(); }
+
+	/**
+	 * @brief Flushes the pending messages and stops the background thread.
+	 * Later messages are written synchronously.
+	 */
+	void shutdown() noexcept
+	{
+		if (!running.exchange(false, std::memory_order_acq_rel)) {
+			return;
+		}
+
+		wakeCond.notify_one();
+		if (consumer.joinable()) {
+			try {
+				consumer.join();
+			} catch (...) {
+				return;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(syncMtx);
+			drain();
+		}
+		flushSuppressed();
+	}
+
+	std::uint64_t getDroppedCount() const noexcept { return droppedCount.load(std::memory_order_relaxed); }
+
+protected:
+	void log(LogLevel level, std::string_view message) const noexcept override
+	{
+		if (message.length() > MESSAGE_CAPACITY || !running.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lock(syncMtx);
+			ObsLogger::writeToBlog(level, message);
+			return;
+		}
+
+		if (!tryEnqueue(level, message)) {
+			droppedCount.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (level >= LogLevel::Error) {
+			wakeCond.notify_one();
+		}
+	}
+
+	const char *getPrefix() const noexcept override { return prefix; }
+
+private:
+	bool tryEnqueue(LogLevel level, std::string_view message) const noexcept
+	{
+		std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &cells[pos & (CAPACITY - 1)];
+			const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const std::intptr_t diff =
+				static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+			if (diff == 0) {
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->level = level;
+		cell->length = static_cast<std::uint16_t>(message.length());
+		std::memcpy(cell->text, message.data(), message.length());
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Writes out every message published so far. Only one thread may drain at a time.
+	 */
+	void drain() noexcept
+	{
+		while (true) {
+			Cell &cell = cells[dequeuePos & (CAPACITY - 1)];
+			if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+				break;
+			}
+			ObsLogger::writeToBlog(cell.level, {cell.text, cell.length});
+			cell.sequence.store(dequeuePos + CAPACITY, std::memory_order_release);
+			dequeuePos++;
+		}
+
+		const std::uint64_t dropped = droppedCount.load(std::memory_order_relaxed);
+		if (dropped != reportedDroppedCount) {
+			char buffer[128];
+			const std::uint64_t count = dropped - reportedDroppedCount;
+			const auto result =
+				fmt::format_to_n(buffer, sizeof(buffer), "{}Dropped {} log messages", prefix, count);
+			ObsLogger::writeToBlog(LogLevel::Warn, {buffer, std::min(result.size, sizeof(buffer))});
+			reportedDroppedCount = dropped;
+		}
+	}
+
+	void consumerLoop() noexcept
+	{
+		auto nextSuppressedReport = std::chrono::steady_clock::now() + SUPPRESSED_REPORT_INTERVAL;
+		while (running.load(std::memory_order_acquire)) {
+			const auto now = std::chrono::steady_clock::now();
+			if (now >= nextSuppressedReport) {
+				flushSuppressed();
+				nextSuppressedReport = now + SUPPRESSED_REPORT_INTERVAL;
+			}
+			drain();
+			std::unique_lock<std::mutex> lock(wakeMtx);
+			wakeCond.wait_for(lock, FLUSH_INTERVAL);
+		}
+		drain();
+	}
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
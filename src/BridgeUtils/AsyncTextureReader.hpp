@@ -29,6 +29,8 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include "BridgeUtils/ObsUnique.hpp"
 #include "BridgeUtils/GsUnique.hpp"
+#include "BridgeUtils/MemoryAccounting.hpp"
+#include "BridgeUtils/TraceRecorder.hpp"
 
 namespace KaitoTokyo {
 namespace BridgeUtils {
@@ -138,6 +140,12 @@ public:
 		  stagesurfs{BridgeUtils::make_unique_gs_stagesurf(width, height, format),
 			     BridgeUtils::make_unique_gs_stagesurf(width, height, format)}
 	{
+		MemoryAccounting::instance().add(MemoryAccounting::Category::ReadbackBuffers, getCpuBufferBytes());
+	}
+
+	~AsyncTextureReader() noexcept
+	{
+		MemoryAccounting::instance().sub(MemoryAccounting::Category::ReadbackBuffers, getCpuBufferBytes());
 	}
 
 	/**
@@ -162,6 +170,8 @@ public:
      */
 	void sync()
 	{
+		TraceScope trace("AsyncTextureReader::sync");
+
 		std::size_t gpuReadIndex;
 		{
 			std::lock_guard<std::mutex> lock(gpuMutex);
@@ -218,6 +228,15 @@ public:
      */
 	std::uint32_t getBufferLinesize() const noexcept { return bufferLinesize; }
 
+	/**
+     * @brief Gets the total size of both CPU buffers.
+     * @return The number of bytes held on the CPU by this reader.
+     */
+	std::int64_t getCpuBufferBytes() const noexcept
+	{
+		return static_cast<std::int64_t>(cpuBuffers[0].size() + cpuBuffers[1].size());
+	}
+
 public:
 	const std::uint32_t width;
 	const std::uint32_t height;
@@ -0,0 +1,208 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <obs.h>
+
+#include "GsUnique.hpp"
+#include "ILogger.hpp"
+#include "LatencyHistogram.hpp"
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+/**
+ * @class GpuPassProfiler
+ * @brief Measures the GPU time of named render passes with graphics timer queries.
+ *
+ * Each frame owns a timer range and one timer per pass. Results are collected when the frame slot comes
+ * around again FRAMES_IN_FLIGHT frames later, so reading them never stalls the render thread. If the GPU
+ * has not finished a slot by then, the frame is simply not profiled.
+ *
+ * All methods except snapshot() and logSummary() must be called from the graphics thread.
+ * Each pass may be timed at most once per frame.
+ */
+class GpuPassProfiler {
+public:
+	static constexpr std::size_t FRAMES_IN_FLIGHT = 4;
+
+	/**
+	 * @brief Times one pass from construction to destruction.
+	 */
+	class Scope {
+	private:
+		gs_timer_t *timer;
+
+	public:
+		explicit Scope(gs_timer_t *_timer) noexcept : timer(_timer)
+		{
+			if (timer) {
+				gs_timer_begin(timer);
+			}
+		}
+
+		~Scope() noexcept
+		{
+			if (timer) {
+				gs_timer_end(timer);
+			}
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+		Scope(Scope &&) = delete;
+		Scope &operator=(Scope &&) = delete;
+	};
+
+private:
+	struct Frame {
+		unique_gs_timer_range_t range;
+		std::vector<unique_gs_timer_t> timers;
+		std::vector<bool> used;
+		bool pending = false;
+	};
+
+	const std::vector<const char *> passNames;
+	const std::unique_ptr<LatencyHistogram[]> histograms;
+	std::array<Frame, FRAMES_IN_FLIGHT> frames;
+	std::size_t frameIndex = 0;
+	bool frameActive = false;
+
+public:
+	/**
+	 * @brief Allocates the timer queries. Must be called within the graphics context.
+	 * @param _passNames The names of the passes, indexed by the pass numbers given to scope().
+	 */
+	explicit GpuPassProfiler(std::vector<const char *> _passNames)
+		: passNames(std::move(_passNames)),
+		  histograms(std::make_unique<LatencyHistogram[]>(passNames.size()))
+	{
+		for (Frame &frame : frames) {
+			frame.range = make_unique_gs_timer_range();
+			for (std::size_t i = 0; i < passNames.size(); i++) {
+				frame.timers.push_back(make_unique_gs_timer());
+			}
+			frame.used.assign(passNames.size(), false);
+		}
+	}
+
+	GpuPassProfiler(const GpuPassProfiler &) = delete;
+	GpuPassProfiler &operator=(const GpuPassProfiler &) = delete;
+	GpuPassProfiler(GpuPassProfiler &&) = delete;
+	GpuPassProfiler &operator=(GpuPassProfiler &&) = delete;
+
+	/**
+	 * @brief Starts profiling a frame after collecting the results of the frame that last used its slot.
+	 */
+	void beginFrame() noexcept
+	{
+		Frame &frame = frames[frameIndex];
+		if (frame.pending && !collect(frame)) {
+			frameActive = false;
+			return;
+		}
+
+		frame.used.assign(passNames.size(), false);
+		gs_timer_range_begin(frame.range.get());
+		frameActive = true;
+	}
+
+	void endFrame() noexcept
+	{
+		if (!frameActive) {
+			return;
+		}
+
+		Frame &frame = frames[frameIndex];
+		gs_timer_range_end(frame.range.get());
+		frame.pending = true;
+		frameIndex = (frameIndex + 1) % FRAMES_IN_FLIGHT;
+		frameActive = false;
+	}
+
+	/**
+	 * @brief Times a pass until the returned scope is destroyed.
+	 * @param pass The index of the pass in the names given to the constructor.
+	 */
+	Scope scope(std::size_t pass) noexcept
+	{
+		if (!frameActive || pass >= passNames.size()) {
+			return Scope(nullptr);
+		}
+
+		Frame &frame = frames[frameIndex];
+		if (frame.used[pass]) {
+			return Scope(nullptr);
+		}
+		frame.used[pass] = true;
+		return Scope(frame.timers[pass].get());
+	}
+
+	std::size_t getPassCount() const noexcept { return passNames.size(); }
+
+	const char *getPassName(std::size_t pass) const noexcept { return passNames[pass]; }
+
+	LatencyHistogram::Snapshot snapshot(std::size_t pass) const noexcept { return histograms[pass].snapshot(); }
+
+	void logSummary(const ILogger &logger) const noexcept
+	{
+		for (std::size_t i = 0; i < passNames.size(); i++) {
+			const LatencyHistogram::Snapshot s = histograms[i].snapshot();
+			if (s.count == 0) {
+				continue;
+			}
+			logger.info("GPU pass {} (us): n={} mean={:.1f} p50={:.1f} p95={:.1f} p99={:.1f} max={:.1f}",
+				    passNames[i], s.count, s.getMeanNs() / 1e3, s.p50Ns / 1e3, s.p95Ns / 1e3,
+				    s.p99Ns / 1e3, s.maxNs / 1e3);
+		}
+	}
+
+private:
+	bool collect(Frame &frame) noexcept
+	{
+		bool disjoint = false;
+		std::uint64_t frequency = 0;
+		if (!gs_timer_range_get_data(frame.range.get(), &disjoint, &frequency)) {
+			return false;
+		}
+
+		if (!disjoint && frequency > 0) {
+			for (std::size_t i = 0; i < passNames.size(); i++) {
+				std::uint64_t ticks = 0;
+				if (frame.used[i] && gs_timer_get_data(frame.timers[i].get(), &ticks)) {
+					const double ns = static_cast<double>(ticks) * 1e9 / frequency;
+					histograms[i].record(static_cast<std::uint64_t>(ns));
+				}
+			}
+		}
+
+		frame.pending = false;
+		return true;
+	}
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
@@ -18,14 +18,19 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 #include <obs.h>
 
+#include "MemoryAccounting.hpp"
 #include "ObsUnique.hpp"
 
 namespace KaitoTokyo {
@@ -33,12 +38,89 @@ namespace BridgeUtils {
 
 namespace GsUnique {
 
+/**
+ * @brief The default cap on the memory held by released textures and stagesurfs kept for reuse.
+ */
+constexpr std::size_t DEFAULT_POOL_CAPACITY_BYTES = 64 * 1024 * 1024;
+
+struct TextureKey {
+	std::uint32_t width;
+	std::uint32_t height;
+	gs_color_format format;
+	std::uint32_t flags;
+
+	bool operator==(const TextureKey &other) const noexcept
+	{
+		return width == other.width && height == other.height && format == other.format &&
+		       flags == other.flags;
+	}
+};
+
+template<typename T> struct PoolEntry {
+	TextureKey key;
+	T *object;
+};
+
 inline std::mutex &getMutex()
 {
 	static std::mutex mtx;
 	return mtx;
 }
 
+/**
+ * @brief The number of objects waiting in the deletion queues. Lets drain() return without locking.
+ */
+inline std::atomic<std::size_t> &getPendingCount()
+{
+	static std::atomic<std::size_t> pendingCount = 0;
+	return pendingCount;
+}
+
+inline std::deque<PoolEntry<gs_texture_t>> &getTexturePool()
+{
+	static std::deque<PoolEntry<gs_texture_t>> texturePool;
+	return texturePool;
+}
+
+inline std::deque<PoolEntry<gs_stagesurf_t>> &getStagesurfPool()
+{
+	static std::deque<PoolEntry<gs_stagesurf_t>> stagesurfPool;
+	return stagesurfPool;
+}
+
+inline std::deque<std::pair<std::string, gs_effect_t *>> &getEffectCache()
+{
+	static std::deque<std::pair<std::string, gs_effect_t *>> effectCache;
+	return effectCache;
+}
+
+inline std::size_t &getPoolRetainedBytes()
+{
+	static std::size_t retainedBytes = 0;
+	return retainedBytes;
+}
+
+inline std::size_t &getPoolCapacityBytes()
+{
+	static std::size_t capacityBytes = DEFAULT_POOL_CAPACITY_BYTES;
+	return capacityBytes;
+}
+
+inline std::size_t getByteSize(const TextureKey &key) noexcept
+{
+	return static_cast<std::size_t>(key.width) * key.height * gs_get_format_bpp(key.format) / 8;
+}
+
+/**
+ * @brief Moves the size of an object between memory accounting categories, e.g. into and out of the pool.
+ */
+inline void account(MemoryAccounting::Category from, MemoryAccounting::Category to, const TextureKey &key) noexcept
+{
+	const auto bytes = static_cast<std::int64_t>(getByteSize(key));
+	MemoryAccounting::instance().sub(from, bytes);
+	MemoryAccounting::instance().add(to, bytes);
+}
+
 inline std::deque<gs_effect_t *> &getEffectsDeque()
 {
 	static std::deque<gs_effect_t *> effectsToDelete;
@@ -57,11 +139,24 @@ inline std::deque<gs_stagesurf_t *> &getStagesurfsDeque()
 	return stagesurfsToDelete;
 }
 
+inline std::deque<gs_timer_t *> &getTimersDeque()
+{
+	static std::deque<gs_timer_t *> timersToDelete;
+	return timersToDelete;
+}
+
+inline std::deque<gs_timer_range_t *> &getTimerRangesDeque()
+{
+	static std::deque<gs_timer_range_t *> timerRangesToDelete;
+	return timerRangesToDelete;
+}
+
 inline void scheduleEffectToDelete(gs_effect_t *effect)
 {
 	if (effect) {
 		std::lock_guard lock(getMutex());
 		getEffectsDeque().push_back(effect);
+		getPendingCount().fetch_add(1, std::memory_order_release);
 	}
 }
 
@@ -70,6 +165,7 @@ inline void scheduleTextureToDelete(gs_texture_t *texture)
 	if (texture) {
 		std::lock_guard lock(getMutex());
 		getTexturesDeque().push_back(texture);
+		getPendingCount().fetch_add(1, std::memory_order_release);
 	}
 }
 
@@ -78,14 +174,143 @@ inline void scheduleStagesurfToDelete(gs_stagesurf_t *surface)
 	if (surface) {
 		std::lock_guard lock(getMutex());
 		getStagesurfsDeque().push_back(surface);
+		getPendingCount().fetch_add(1, std::memory_order_release);
+	}
+}
+
+inline void scheduleTimerToDelete(gs_timer_t *timer)
+{
+	if (timer) {
+		std::lock_guard lock(getMutex());
+		getTimersDeque().push_back(timer);
+		getPendingCount().fetch_add(1, std::memory_order_release);
+	}
+}
+
+inline void scheduleTimerRangeToDelete(gs_timer_range_t *range)
+{
+	if (range) {
+		std::lock_guard lock(getMutex());
+		getTimerRangesDeque().push_back(range);
+		getPendingCount().fetch_add(1, std::memory_order_release);
+	}
+}
+
+/**
+ * @brief Keeps released objects for reuse, evicting the least recently released ones over the capacity.
+ * Must be called with the mutex held.
+ */
+inline void trimPools()
+{
+	std::size_t &retainedBytes = getPoolRetainedBytes();
+	while (retainedBytes > getPoolCapacityBytes()) {
+		auto &texturePool = getTexturePool();
+		auto &stagesurfPool = getStagesurfPool();
+		if (!texturePool.empty()) {
+			const std::size_t bytes = getByteSize(texturePool.front().key);
+			retainedBytes -= bytes;
+			MemoryAccounting::instance().sub(MemoryAccounting::Category::GpuPool,
+							 static_cast<std::int64_t>(bytes));
+			getTexturesDeque().push_back(texturePool.front().object);
+			texturePool.pop_front();
+		} else if (!stagesurfPool.empty()) {
+			const std::size_t bytes = getByteSize(stagesurfPool.front().key);
+			retainedBytes -= bytes;
+			MemoryAccounting::instance().sub(MemoryAccounting::Category::GpuPool,
+							 static_cast<std::int64_t>(bytes));
+			getStagesurfsDeque().push_back(stagesurfPool.front().object);
+			stagesurfPool.pop_front();
+		} else {
+			break;
+		}
+		getPendingCount().fetch_add(1, std::memory_order_release);
+	}
+}
+
+inline void releaseTextureToPool(gs_texture_t *texture, const TextureKey &key)
+{
+	if (texture) {
+		std::lock_guard lock(getMutex());
+		getTexturePool().push_back({key, texture});
+		getPoolRetainedBytes() += getByteSize(key);
+		account(MemoryAccounting::Category::GpuTextures, MemoryAccounting::Category::GpuPool, key);
+		trimPools();
+	}
+}
+
+inline void releaseStagesurfToPool(gs_stagesurf_t *surface, const TextureKey &key)
+{
+	if (surface) {
+		std::lock_guard lock(getMutex());
+		getStagesurfPool().push_back({key, surface});
+		getPoolRetainedBytes() += getByteSize(key);
+		account(MemoryAccounting::Category::GpuStagesurfs, MemoryAccounting::Category::GpuPool, key);
+		trimPools();
+	}
+}
+
+template<typename T>
+inline T *takeFromPool(std::deque<PoolEntry<T>> &pool, const TextureKey &key, MemoryAccounting::Category category)
+{
+	std::lock_guard lock(getMutex());
+	for (auto it = pool.rbegin(); it != pool.rend(); ++it) {
+		if (it->key == key) {
+			T *object = it->object;
+			getPoolRetainedBytes() -= getByteSize(key);
+			account(MemoryAccounting::Category::GpuPool, category, key);
+			pool.erase(std::next(it).base());
+			return object;
+		}
 	}
+	return nullptr;
+}
+
+/**
+ * @brief Sets the cap on the memory held by pooled textures and stagesurfs. 0 disables pooling.
+ */
+inline void setPoolCapacityBytes(std::size_t capacityBytes)
+{
+	std::lock_guard lock(getMutex());
+	getPoolCapacityBytes() = capacityBytes;
+	trimPools();
+}
+
+/**
+ * @brief Schedules every pooled and cached object for deletion. Call before the final drain().
+ */
+inline void clearPools()
+{
+	std::lock_guard lock(getMutex());
+	for (const PoolEntry<gs_texture_t> &entry : getTexturePool()) {
+		getTexturesDeque().push_back(entry.object);
+	}
+	for (const PoolEntry<gs_stagesurf_t> &entry : getStagesurfPool()) {
+		getStagesurfsDeque().push_back(entry.object);
+	}
+	for (const auto &[path, effect] : getEffectCache()) {
+		getEffectsDeque().push_back(effect);
+	}
+	getPendingCount().fetch_add(getTexturePool().size() + getStagesurfPool().size() + getEffectCache().size(),
+				    std::memory_order_release);
+	getTexturePool().clear();
+	getStagesurfPool().clear();
+	getEffectCache().clear();
+	MemoryAccounting::instance().sub(MemoryAccounting::Category::GpuPool,
+					 static_cast<std::int64_t>(getPoolRetainedBytes()));
+	getPoolRetainedBytes() = 0;
 }
 
 inline void drain()
 {
+	if (getPendingCount().load(std::memory_order_acquire) == 0) {
+		return;
+	}
+
 	std::deque<gs_effect_t *> _effects_to_delete;
 	std::deque<gs_texture_t *> _textures_to_delete;
 	std::deque<gs_stagesurf_t *> _stagesurfs_to_delete;
+	std::deque<gs_timer_t *> _timers_to_delete;
+	std::deque<gs_timer_range_t *> _timer_ranges_to_delete;
 	{
 		std::lock_guard lock(getMutex());
 		if (!getEffectsDeque().empty()) {
@@ -97,6 +322,13 @@ inline void drain()
 		if (!getStagesurfsDeque().empty()) {
 			_stagesurfs_to_delete = std::move(getStagesurfsDeque());
 		}
+		if (!getTimersDeque().empty()) {
+			_timers_to_delete = std::move(getTimersDeque());
+		}
+		if (!getTimerRangesDeque().empty()) {
+			_timer_ranges_to_delete = std::move(getTimerRangesDeque());
+		}
+		getPendingCount().store(0, std::memory_order_release);
 	}
 
 	for (gs_effect_t *effect : _effects_to_delete) {
@@ -108,26 +340,86 @@ inline void drain()
 	for (gs_stagesurf_t *surface : _stagesurfs_to_delete) {
 		gs_stagesurface_destroy(surface);
 	}
+	for (gs_timer_t *timer : _timers_to_delete) {
+		gs_timer_destroy(timer);
+	}
+	for (gs_timer_range_t *range : _timer_ranges_to_delete) {
+		gs_timer_range_destroy(range);
+	}
 }
 
 struct GsEffectDeleter {
-	void operator()(gs_effect_t *effect) const { scheduleEffectToDelete(effect); }
+	/** @brief Whether the effect is owned by the effect cache, which destroys it in clearPools(). */
+	bool cached = false;
+
+	void operator()(gs_effect_t *effect) const
+	{
+		if (!cached) {
+			scheduleEffectToDelete(effect);
+		}
+	}
 };
 
 struct GsTextureDeleter {
-	void operator()(gs_texture_t *texture) const { scheduleTextureToDelete(texture); }
+	TextureKey key{};
+	bool pooled = false;
+
+	void operator()(gs_texture_t *texture) const
+	{
+		if (pooled) {
+			releaseTextureToPool(texture, key);
+		} else {
+			MemoryAccounting::instance().sub(MemoryAccounting::Category::GpuTextures,
+							 static_cast<std::int64_t>(getByteSize(key)));
+			scheduleTextureToDelete(texture);
+		}
+	}
 };
 
 struct GsStagesurfDeleter {
-	void operator()(gs_stagesurf_t *surface) const { scheduleStagesurfToDelete(surface); }
+	TextureKey key{};
+	bool pooled = false;
+
+	void operator()(gs_stagesurf_t *surface) const
+	{
+		if (pooled) {
+			releaseStagesurfToPool(surface, key);
+		} else {
+			MemoryAccounting::instance().sub(MemoryAccounting::Category::GpuStagesurfs,
+							 static_cast<std::int64_t>(getByteSize(key)));
+			scheduleStagesurfToDelete(surface);
+		}
+	}
+};
+
+struct GsTimerDeleter {
+	void operator()(gs_timer_t *timer) const { scheduleTimerToDelete(timer); }
+};
+
+struct GsTimerRangeDeleter {
+	void operator()(gs_timer_range_t *range) const { scheduleTimerRangeToDelete(range); }
 };
 
 } // namespace GsUnique
 
 using unique_gs_effect_t = std::unique_ptr<gs_effect_t, GsUnique::GsEffectDeleter>;
 
+/**
+ * @brief Loads an effect, or returns the one compiled earlier from the same path.
+ * Cached effects are shared and stay compiled until GsUnique::clearPools().
+ */
 inline unique_gs_effect_t make_unique_gs_effect_from_file(const unique_bfree_char_t &file)
 {
+	const std::string path(file.get());
+	{
+		std::lock_guard lock(GsUnique::getMutex());
+		for (const auto &[cachedPath, cachedEffect] : GsUnique::getEffectCache()) {
+			if (cachedPath == path) {
+				return unique_gs_effect_t(cachedEffect, GsUnique::GsEffectDeleter{true});
+			}
+		}
+	}
+
 	char *raw_error_string = nullptr;
 	gs_effect_t *raw_effect = gs_effect_create_from_file(file.get(), &raw_error_string);
 	unique_bfree_char_t error_string(raw_error_string);
@@ -136,32 +428,83 @@ inline unique_gs_effect_t make_unique_gs_effect_from_file(const unique_bfree_cha
 		throw std::runtime_error(std::string("gs_effect_create_from_file failed: ") +
 					 (error_string ? error_string.get() : "(unknown error)"));
 	}
-	return unique_gs_effect_t(raw_effect);
+
+	std::lock_guard lock(GsUnique::getMutex());
+	GsUnique::getEffectCache().emplace_back(path, raw_effect);
+	return unique_gs_effect_t(raw_effect, GsUnique::GsEffectDeleter{true});
 }
 
 using unique_gs_texture_t = std::unique_ptr<gs_texture_t, GsUnique::GsTextureDeleter>;
 
+/**
+ * @brief Creates a texture. Single-level textures without initial data are reused from the pool when one
+ * with the same size, format and flags was released, and return to the pool when released.
+ */
 inline unique_gs_texture_t make_unique_gs_texture(std::uint32_t width, std::uint32_t height,
 						  enum gs_color_format color_format, std::uint32_t levels,
 						  const std::uint8_t **data, std::uint32_t flags)
 {
+	const bool poolable = levels == 1 && !data;
+	const GsUnique::TextureKey key{width, height, color_format, flags};
+	if (poolable) {
+		if (gs_texture_t *pooled = GsUnique::takeFromPool(GsUnique::getTexturePool(), key,
+								  MemoryAccounting::Category::GpuTextures)) {
+			return unique_gs_texture_t(pooled, GsUnique::GsTextureDeleter{key, true});
+		}
+	}
+
 	gs_texture_t *rawTexture = gs_texture_create(width, height, color_format, levels, data, flags);
 	if (!rawTexture) {
 		throw std::runtime_error("gs_texture_create failed");
 	}
-	return unique_gs_texture_t(rawTexture);
+	MemoryAccounting::instance().add(MemoryAccounting::Category::GpuTextures,
+					 static_cast<std::int64_t>(GsUnique::getByteSize(key)));
+	return unique_gs_texture_t(rawTexture, GsUnique::GsTextureDeleter{key, poolable});
 }
 
 using unique_gs_stagesurf_t = std::unique_ptr<gs_stagesurf_t, GsUnique::GsStagesurfDeleter>;
 
+/**
+ * @brief Creates a stagesurf, reusing a pooled one of the same size and format if available.
+ */
 inline unique_gs_stagesurf_t make_unique_gs_stagesurf(std::uint32_t width, std::uint32_t height,
 						      enum gs_color_format color_format)
 {
+	const GsUnique::TextureKey key{width, height, color_format, 0};
+	if (gs_stagesurf_t *pooled = GsUnique::takeFromPool(GsUnique::getStagesurfPool(), key,
+							    MemoryAccounting::Category::GpuStagesurfs)) {
+		return unique_gs_stagesurf_t(pooled, GsUnique::GsStagesurfDeleter{key, true});
+	}
+
 	gs_stagesurf_t *rawSurface = gs_stagesurface_create(width, height, color_format);
 	if (!rawSurface) {
 		throw std::runtime_error("gs_stagesurface_create failed");
 	}
-	return unique_gs_stagesurf_t(rawSurface);
+	MemoryAccounting::instance().add(MemoryAccounting::Category::GpuStagesurfs,
+					 static_cast<std::int64_t>(GsUnique::getByteSize(key)));
+	return unique_gs_stagesurf_t(rawSurface, GsUnique::GsStagesurfDeleter{key, true});
+}
+
+using unique_gs_timer_t = std::unique_ptr<gs_timer_t, GsUnique::GsTimerDeleter>;
+
+inline unique_gs_timer_t make_unique_gs_timer()
+{
+	gs_timer_t *rawTimer = gs_timer_create();
+	if (!rawTimer) {
+		throw std::runtime_error("gs_timer_create failed");
+	}
+	return unique_gs_timer_t(rawTimer);
+}
+
+using unique_gs_timer_range_t = std::unique_ptr<gs_timer_range_t, GsUnique::GsTimerRangeDeleter>;
+
+inline unique_gs_timer_range_t make_unique_gs_timer_range()
+{
+	gs_timer_range_t *rawRange = gs_timer_range_create();
+	if (!rawRange) {
+		throw std::runtime_error("gs_timer_range_create failed");
+	}
+	return unique_gs_timer_range_t(rawRange);
 }
 
 class GraphicsContextGuard {
@@ -18,6 +18,7 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <iterator>
@@ -28,6 +29,8 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include <fmt/format.h>
 
+#include "LogSite.hpp"
+
 #ifdef HAVE_BACKWARD
 #include <backward.hpp>
 #endif // HAVE_BACKWARD
@@ -37,32 +40,75 @@ namespace BridgeUtils {
 
 class ILogger {
 public:
+	enum class LogLevel : std::int8_t { Debug, Info, Warn, Error };
+
 	ILogger() noexcept = default;
 	virtual ~ILogger() noexcept = default;
 
 	ILogger(ILogger &&) = delete;
 	ILogger &operator=(ILogger &&) = delete;
 
+	/**
+	 * @brief Discards messages below the given level before they are formatted.
+	 */
+	void setMinLevel(LogLevel level) noexcept { minLevel.store(level, std::memory_order_relaxed); }
+
+	bool isEnabled(LogLevel level) const noexcept { return level >= minLevel.load(std::memory_order_relaxed); }
+
+#ifdef BRIDGE_UTILS_DISABLE_DEBUG_LOG
+
+	template<typename... Args> void debug(fmt::format_string<Args...>, Args &&...) const noexcept {}
+
+	template<typename... Args> void debug(LogSite &, fmt::format_string<Args...>, Args &&...) const noexcept {}
+
+#else // !BRIDGE_UTILS_DISABLE_DEBUG_LOG
+
 	template<typename... Args> void debug(fmt::format_string<Args...> fmt, Args &&...args) const noexcept
 	{
 		formatAndLog(LogLevel::Debug, fmt, std::forward<Args>(args)...);
 	}
 
+	template<typename... Args>
+	void debug(LogSite &site, fmt::format_string<Args...> fmt, Args &&...args) const noexcept
+	{
+		formatAndLog(site, LogLevel::Debug, fmt, std::forward<Args>(args)...);
+	}
+
+#endif // BRIDGE_UTILS_DISABLE_DEBUG_LOG
+
 	template<typename... Args> void info(fmt::format_string<Args...> fmt, Args &&...args) const noexcept
 	{
 		formatAndLog(LogLevel::Info, fmt, std::forward<Args>(args)...);
 	}
 
+	template<typename... Args>
+	void info(LogSite &site, fmt::format_string<Args...> fmt, Args &&...args) const noexcept
+	{
+		formatAndLog(site, LogLevel::Info, fmt, std::forward<Args>(args)...);
+	}
+
 	template<typename... Args> void warn(fmt::format_string<Args...> fmt, Args &&...args) const noexcept
 	{
 		formatAndLog(LogLevel::Warn, fmt, std::forward<Args>(args)...);
 	}
 
+	template<typename... Args>
+	void warn(LogSite &site, fmt::format_string<Args...> fmt, Args &&...args) const noexcept
+	{
+		formatAndLog(site, LogLevel::Warn, fmt, std::forward<Args>(args)...);
+	}
+
 	template<typename... Args> void error(fmt::format_string<Args...> fmt, Args &&...args) const noexcept
 	{
 		formatAndLog(LogLevel::Error, fmt, std::forward<Args>(args)...);
 	}
 
+	template<typename... Args>
+	void error(LogSite &site, fmt::format_string<Args...> fmt, Args &&...args) const noexcept
+	{
+		formatAndLog(site, LogLevel::Error, fmt, std::forward<Args>(args)...);
+	}
+
 #ifdef HAVE_BACKWARD
 
 	virtual void logException(const std::exception &e, std::string_view context) const noexcept
@@ -92,27 +138,81 @@ public:
 
 #endif // HAVE_BACKWARD
 
-protected:
-	enum class LogLevel : std::int8_t { Debug, Info, Warn, Error };
+	/**
+	 * @brief Reports the messages that rate-limited sites suppressed and no later message from the site reported.
+	 */
+	void flushSuppressed() const noexcept
+	try {
+		LogSite::flushSuppressed([this](std::int8_t level, std::string_view format, std::uint64_t count) {
+			if (!isEnabled(static_cast<LogLevel>(level))) {
+				return;
+			}
+			fmt::memory_buffer buffer;
+			fmt::format_to(std::back_inserter(buffer), "{}Suppressed {} messages like: {}", getPrefix(),
+				       count, format);
+			log(static_cast<LogLevel>(level), {buffer.data(), buffer.size()});
+		});
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s: [LOGGER FATAL] Failed to report suppressed messages: %s\n", getPrefix(),
+			e.what());
+	} catch (...) {
+		fprintf(stderr, "%s: [LOGGER FATAL] An unknown error occurred while reporting suppressed messages.\n",
+			getPrefix());
+	}
 
+protected:
 	virtual void log(LogLevel level, std::string_view message) const noexcept = 0;
 
 	virtual const char *getPrefix() const noexcept = 0;
 
 private:
+	std::atomic<LogLevel> minLevel = LogLevel::Debug;
+
 	template<typename... Args>
 	void formatAndLog(LogLevel level, fmt::format_string<Args...> fmt, Args &&...args) const noexcept
 	try {
-		fmt::memory_buffer buffer;
-		fmt::format_to(std::back_inserter(buffer), "{}", getPrefix());
-		fmt::vformat_to(std::back_inserter(buffer), fmt, fmt::make_format_args(args...));
-		log(level, {buffer.data(), buffer.size()});
+		if (!isEnabled(level)) {
+			return;
+		}
+
+		formatAndLogUnchecked(level, 0, fmt, std::forward<Args>(args)...);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s: [LOGGER FATAL] Failed to format log message: %s\n", getPrefix(), e.what());
+	} catch (...) {
+		fprintf(stderr, "%s: [LOGGER FATAL] An unknown error occurred while formatting log message.\n",
+			getPrefix());
+	}
+
+	template<typename... Args>
+	void formatAndLog(LogSite &site, LogLevel level, fmt::format_string<Args...> fmt, Args &&...args) const noexcept
+	try {
+		std::uint64_t suppressed = 0;
+		const fmt::string_view format = fmt;
+		if (!isEnabled(level) || !site.tryAcquire(suppressed, static_cast<std::int8_t>(level),
+							 std::string_view(format.data(), format.size()))) {
+			return;
+		}
+
+		formatAndLogUnchecked(level, suppressed, fmt, std::forward<Args>(args)...);
 	} catch (const std::exception &e) {
 		fprintf(stderr, "%s: [LOGGER FATAL] Failed to format log message: %s\n", getPrefix(), e.what());
 	} catch (...) {
 		fprintf(stderr, "%s: [LOGGER FATAL] An unknown error occurred while formatting log message.\n",
 			getPrefix());
 	}
+
+	template<typename... Args>
+	void formatAndLogUnchecked(LogLevel level, std::uint64_t suppressed, fmt::format_string<Args...> fmt,
+				   Args &&...args) const
+	{
+		fmt::memory_buffer buffer;
+		fmt::format_to(std::back_inserter(buffer), "{}", getPrefix());
+		fmt::vformat_to(std::back_inserter(buffer), fmt, fmt::make_format_args(args...));
+		if (suppressed > 0) {
+			fmt::format_to(std::back_inserter(buffer), " (suppressed {} similar messages)", suppressed);
+		}
+		log(level, {buffer.data(), buffer.size()});
+	}
 };
 
 } // namespace BridgeUtils
@@ -0,0 +1,116 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+template<typename Signature, std::size_t Capacity> class InplaceFunction;
+
+/**
+ * @class InplaceFunction
+ * @brief A move-only std::function replacement that stores its callable inline and never allocates.
+ *
+ * Callables larger than Capacity bytes are rejected at compile time rather than spilled to the heap.
+ */
+template<typename R, typename... Args, std::size_t Capacity> class InplaceFunction<R(Args...), Capacity> {
+private:
+	struct VTable {
+		R (*invoke)(void *storage, Args &&...args);
+		void (*moveConstruct)(void *destination, void *source) noexcept;
+		void (*destroy)(void *storage) noexcept;
+	};
+
+	template<typename F>
+	static inline const VTable vtableFor = {
+		[](void *storage, Args &&...args) -> R {
+			return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+		},
+		[](void *destination, void *source) noexcept {
+			new (destination) F(std::move(*static_cast<F *>(source)));
+			static_cast<F *>(source)->~F();
+		},
+		[](void *storage) noexcept { static_cast<F *>(storage)->~F(); },
+	};
+
+	alignas(std::max_align_t) unsigned char storage[Capacity];
+	const VTable *vtable = nullptr;
+
+public:
+	InplaceFunction() noexcept = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InplaceFunction> &&
+							 std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>>
+	InplaceFunction(F &&f) noexcept(std::is_nothrow_constructible_v<std::decay_t<F>, F &&>)
+	{
+		using Callable = std::decay_t<F>;
+		static_assert(sizeof(Callable) <= Capacity, "Callable is too large for this InplaceFunction");
+		static_assert(alignof(Callable) <= alignof(std::max_align_t), "Callable is over-aligned");
+		static_assert(std::is_nothrow_move_constructible_v<Callable>, "Callable must be nothrow movable");
+
+		new (storage) Callable(std::forward<F>(f));
+		vtable = &vtableFor<Callable>;
+	}
+
+	InplaceFunction(InplaceFunction &&other) noexcept : vtable(other.vtable)
+	{
+		if (vtable) {
+			vtable->moveConstruct(storage, other.storage);
+			other.vtable = nullptr;
+		}
+	}
+
+	InplaceFunction &operator=(InplaceFunction &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			if (other.vtable) {
+				other.vtable->moveConstruct(storage, other.storage);
+				vtable = other.vtable;
+				other.vtable = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	InplaceFunction(const InplaceFunction &) = delete;
+	InplaceFunction &operator=(const InplaceFunction &) = delete;
+
+	~InplaceFunction() noexcept { reset(); }
+
+	void reset() noexcept
+	{
+		if (vtable) {
+			vtable->destroy(storage);
+			vtable = nullptr;
+		}
+	}
+
+	explicit operator bool() const noexcept { return vtable != nullptr; }
+
+	R operator()(Args... args) { return vtable->invoke(storage, std::forward<Args>(args)...); }
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
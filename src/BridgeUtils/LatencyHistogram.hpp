@@ -0,0 +1,208 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+namespace LatencyHistogramDetail {
+
+inline std::uint32_t getMostSignificantBit(std::uint64_t value) noexcept
+{
+	std::uint32_t msb = 0;
+	for (std::uint32_t shift = 32; shift > 0; shift /= 2) {
+		if (value >> shift) {
+			value >>= shift;
+			msb += shift;
+		}
+	}
+	return msb;
+}
+
+} // namespace LatencyHistogramDetail
+
+/**
+ * @class LatencyHistogram
+ * @brief A lock-free log-linear histogram of durations in nanoseconds, in the spirit of HdrHistogram.
+ *
+ * Values below 2^SUB_BUCKET_BITS are counted exactly. Above that, every power of two is split into
+ * 2^SUB_BUCKET_BITS linear sub-buckets, which bounds the relative error of a reported percentile to about 6%.
+ * record() may be called from any number of threads concurrently with snapshot().
+ */
+class LatencyHistogram {
+public:
+	static constexpr std::uint32_t SUB_BUCKET_BITS = 4;
+	static constexpr std::uint32_t SUB_BUCKET_COUNT = 1u << SUB_BUCKET_BITS;
+	static constexpr std::size_t BUCKET_COUNT = SUB_BUCKET_COUNT + (64 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+
+	/**
+	 * @brief A consistent-enough copy of the histogram statistics.
+	 */
+	struct Snapshot {
+		std::uint64_t count = 0;
+		std::uint64_t sumNs = 0;
+		std::uint64_t p50Ns = 0;
+		std::uint64_t p95Ns = 0;
+		std::uint64_t p99Ns = 0;
+		std::uint64_t maxNs = 0;
+
+		double getMeanNs() const noexcept
+		{
+			return count ? static_cast<double>(sumNs) / static_cast<double>(count) : 0.0;
+		}
+	};
+
+private:
+	std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> buckets{};
+	std::atomic<std::uint64_t> sumNs = 0;
+	std::atomic<std::uint64_t> maxNs = 0;
+
+public:
+	LatencyHistogram() noexcept = default;
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+	LatencyHistogram(LatencyHistogram &&) = delete;
+	LatencyHistogram &operator=(LatencyHistogram &&) = delete;
+
+	static std::size_t getBucketIndex(std::uint64_t valueNs) noexcept
+	{
+		if (valueNs < SUB_BUCKET_COUNT) {
+			return static_cast<std::size_t>(valueNs);
+		}
+		const std::uint32_t msb = LatencyHistogramDetail::getMostSignificantBit(valueNs);
+		const std::uint64_t subBucket = (valueNs >> (msb - SUB_BUCKET_BITS)) - SUB_BUCKET_COUNT;
+		const std::size_t exponent = msb - SUB_BUCKET_BITS;
+		return SUB_BUCKET_COUNT + exponent * SUB_BUCKET_COUNT + static_cast<std::size_t>(subBucket);
+	}
+
+	/**
+	 * @brief Returns the highest value that falls into a bucket.
+	 */
+	static std::uint64_t getBucketUpperBound(std::size_t index) noexcept
+	{
+		if (index < SUB_BUCKET_COUNT) {
+			return index;
+		}
+		const std::size_t exponent = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+		const std::uint64_t subBucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+		const std::uint64_t lowerBound = (SUB_BUCKET_COUNT + subBucket) << exponent;
+		return lowerBound + ((std::uint64_t{1} << exponent) - 1);
+	}
+
+	void record(std::uint64_t valueNs) noexcept
+	{
+		buckets[getBucketIndex(valueNs)].fetch_add(1, std::memory_order_relaxed);
+		sumNs.fetch_add(valueNs, std::memory_order_relaxed);
+
+		std::uint64_t currentMax = maxNs.load(std::memory_order_relaxed);
+		while (valueNs > currentMax &&
+		       !maxNs.compare_exchange_weak(currentMax, valueNs, std::memory_order_relaxed)) {
+		}
+	}
+
+	Snapshot snapshot() const noexcept
+	{
+		std::array<std::uint64_t, BUCKET_COUNT> counts;
+		std::uint64_t total = 0;
+		for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+			counts[i] = buckets[i].load(std::memory_order_relaxed);
+			total += counts[i];
+		}
+
+		Snapshot result;
+		result.count = total;
+		result.sumNs = sumNs.load(std::memory_order_relaxed);
+		result.maxNs = maxNs.load(std::memory_order_relaxed);
+		if (total == 0) {
+			return result;
+		}
+
+		const std::uint64_t p50Rank = (total * 50 + 99) / 100;
+		const std::uint64_t p95Rank = (total * 95 + 99) / 100;
+		const std::uint64_t p99Rank = (total * 99 + 99) / 100;
+
+		std::uint64_t cumulative = 0;
+		for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+			if (counts[i] == 0) {
+				continue;
+			}
+			const std::uint64_t previous = cumulative;
+			cumulative += counts[i];
+			const std::uint64_t upperBound = getBucketUpperBound(i);
+			if (previous < p50Rank && cumulative >= p50Rank) {
+				result.p50Ns = upperBound;
+			}
+			if (previous < p95Rank && cumulative >= p95Rank) {
+				result.p95Ns = upperBound;
+			}
+			if (cumulative >= p99Rank) {
+				result.p99Ns = upperBound;
+				break;
+			}
+		}
+
+		// Bucket bounds can overshoot the exact maximum that was recorded.
+		result.p50Ns = std::min(result.p50Ns, result.maxNs);
+		result.p95Ns = std::min(result.p95Ns, result.maxNs);
+		result.p99Ns = std::min(result.p99Ns, result.maxNs);
+		return result;
+	}
+
+	std::uint64_t getSumNs() const noexcept { return sumNs.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Counts the values at or below each of ascending bounds, for exporting as fixed buckets.
+	 * A bucket is counted under the first bound that is not below its upper bound, so a count may lag by
+	 * the width of one bucket. The last element is the total count.
+	 */
+	template<std::size_t N>
+	std::array<std::uint64_t, N + 1>
+	getCumulativeCounts(const std::array<std::uint64_t, N> &boundsNs) const noexcept
+	{
+		std::array<std::uint64_t, N + 1> result{};
+		std::size_t bound = 0;
+		std::uint64_t cumulative = 0;
+		for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+			const std::uint64_t count = buckets[i].load(std::memory_order_relaxed);
+			if (count == 0) {
+				continue;
+			}
+			const std::uint64_t upperBound = getBucketUpperBound(i);
+			while (bound < N && boundsNs[bound] < upperBound) {
+				result[bound++] = cumulative;
+			}
+			cumulative += count;
+		}
+		while (bound < N) {
+			result[bound++] = cumulative;
+		}
+		result[N] = cumulative;
+		return result;
+	}
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
@@ -0,0 +1,130 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+/**
+ * @class LogSite
+ * @brief A rate limit for one log statement that keeps count of what it suppressed.
+ *
+ * Each site is a token bucket refilled at ratePerSecond and holding up to burst messages, implemented as a
+ * single atomic theoretical arrival time (GCRA). Messages over the limit are counted instead of formatted,
+ * and the next message that passes reports how many were suppressed, so a repeating message collapses into
+ * periodic summaries. A message that stops repeating leaves its count behind, so the first suppression also
+ * links the site into a process-wide list that flushSuppressed() walks to report what no later message did.
+ * Declare sites as function-local statics next to the statement they limit; sites are never unlinked.
+ */
+class LogSite {
+private:
+	const std::int64_t emissionIntervalNs;
+	const std::int64_t burstToleranceNs;
+	std::atomic<std::int64_t> theoreticalArrivalNs = 0;
+	std::atomic<std::uint64_t> suppressedCount = 0;
+
+	std::atomic<bool> linked = false;
+	/** level and format are set once, before the site is published to the list. */
+	std::int8_t level = 0;
+	std::string_view format;
+	LogSite *next = nullptr;
+
+	static std::atomic<LogSite *> &getHead() noexcept
+	{
+		static std::atomic<LogSite *> head = nullptr;
+		return head;
+	}
+
+	void link(std::int8_t _level, std::string_view _format) noexcept
+	{
+		if (linked.exchange(true, std::memory_order_relaxed)) {
+			return;
+		}
+		level = _level;
+		format = _format;
+		std::atomic<LogSite *> &head = getHead();
+		next = head.load(std::memory_order_relaxed);
+		while (!head.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) {
+		}
+	}
+
+public:
+	explicit LogSite(double ratePerSecond = 1.0 / 10.0, double burst = 3.0) noexcept
+		: emissionIntervalNs(static_cast<std::int64_t>(1e9 / ratePerSecond)),
+		  burstToleranceNs(static_cast<std::int64_t>(1e9 / ratePerSecond * burst))
+	{
+	}
+
+	LogSite(const LogSite &) = delete;
+	LogSite &operator=(const LogSite &) = delete;
+
+	/**
+	 * @brief Takes a token if one is available.
+	 * @param suppressed Receives the number of messages suppressed since the last one that passed or was flushed.
+	 * @param _level The level of the statement, reported by flushSuppressed().
+	 * @param _format The format string of the statement, reported by flushSuppressed(). Must outlive the site.
+	 * @return Whether the message may be logged.
+	 */
+	bool tryAcquire(std::uint64_t &suppressed, std::int8_t _level, std::string_view _format) noexcept
+	{
+		const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+						 std::chrono::steady_clock::now().time_since_epoch())
+						 .count();
+
+		std::int64_t arrival = theoreticalArrivalNs.load(std::memory_order_relaxed);
+		while (true) {
+			const std::int64_t nextArrival = std::max(arrival, now) + emissionIntervalNs;
+			if (nextArrival - now > burstToleranceNs) {
+				suppressedCount.fetch_add(1, std::memory_order_relaxed);
+				link(_level, _format);
+				return false;
+			}
+			if (theoreticalArrivalNs.compare_exchange_weak(arrival, nextArrival,
+								       std::memory_order_relaxed)) {
+				break;
+			}
+		}
+
+		suppressed = suppressedCount.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	 * @brief Takes the outstanding count of every site that has suppressed a message.
+	 * @param callback Called as callback(level, format, count) for each site whose count is not zero.
+	 */
+	template<typename Callback> static void flushSuppressed(Callback &&callback)
+	{
+		for (LogSite *site = getHead().load(std::memory_order_acquire); site; site = site->next) {
+			const std::uint64_t count = site->suppressedCount.exchange(0, std::memory_order_relaxed);
+			if (count > 0) {
+				callback(site->level, site->format, count);
+			}
+		}
+	}
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
@@ -0,0 +1,162 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "ILogger.hpp"
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+/**
+ * @class MemoryAccounting
+ * @brief A process-wide registry of the memory held by the plugin, by category.
+ *
+ * Subsystems report their allocations and frees with add() and sub(), or publish a current value with set().
+ * Every category keeps its current size and high-water mark in atomics, so updates never lock.
+ * An optional soft budget lets callers ask whether they should degrade instead of growing.
+ */
+class MemoryAccounting {
+public:
+	enum class Category : std::size_t {
+		GpuTextures,
+		GpuStagesurfs,
+		GpuPool,
+		ReadbackBuffers,
+		NcnnAllocator,
+		WebSocketSendBuffers,
+		Count,
+	};
+
+	static constexpr std::size_t CATEGORY_COUNT = static_cast<std::size_t>(Category::Count);
+
+	static const char *getCategoryName(Category category) noexcept
+	{
+		switch (category) {
+		case Category::GpuTextures:
+			return "GPU textures";
+		case Category::GpuStagesurfs:
+			return "GPU stagesurfs";
+		case Category::GpuPool:
+			return "GPU pool";
+		case Category::ReadbackBuffers:
+			return "readback buffers";
+		case Category::NcnnAllocator:
+			return "ncnn allocator";
+		case Category::WebSocketSendBuffers:
+			return "WebSocket send buffers";
+		default:
+			return "unknown";
+		}
+	}
+
+private:
+	struct Counter {
+		std::atomic<std::int64_t> currentBytes = 0;
+		std::atomic<std::int64_t> peakBytes = 0;
+	};
+
+	std::array<Counter, CATEGORY_COUNT> counters;
+	std::atomic<std::int64_t> totalBytes = 0;
+	std::atomic<std::int64_t> peakTotalBytes = 0;
+	std::atomic<std::int64_t> softBudgetBytes = 0;
+
+	MemoryAccounting() noexcept = default;
+
+	static void raisePeak(std::atomic<std::int64_t> &peak, std::int64_t value) noexcept
+	{
+		std::int64_t current = peak.load(std::memory_order_relaxed);
+		while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+		}
+	}
+
+public:
+	static MemoryAccounting &instance() noexcept
+	{
+		static MemoryAccounting accounting;
+		return accounting;
+	}
+
+	MemoryAccounting(const MemoryAccounting &) = delete;
+	MemoryAccounting &operator=(const MemoryAccounting &) = delete;
+
+	void add(Category category, std::int64_t bytes) noexcept
+	{
+		Counter &counter = counters[static_cast<std::size_t>(category)];
+		raisePeak(counter.peakBytes, counter.currentBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+		raisePeak(peakTotalBytes, totalBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	}
+
+	void sub(Category category, std::int64_t bytes) noexcept { add(category, -bytes); }
+
+	/**
+	 * @brief Replaces the current size of a category that is sampled rather than tracked.
+	 */
+	void set(Category category, std::int64_t bytes) noexcept
+	{
+		Counter &counter = counters[static_cast<std::size_t>(category)];
+		add(category, bytes - counter.currentBytes.load(std::memory_order_relaxed));
+	}
+
+	std::int64_t getCurrentBytes(Category category) const noexcept
+	{
+		return counters[static_cast<std::size_t>(category)].currentBytes.load(std::memory_order_relaxed);
+	}
+
+	std::int64_t getPeakBytes(Category category) const noexcept
+	{
+		return counters[static_cast<std::size_t>(category)].peakBytes.load(std::memory_order_relaxed);
+	}
+
+	std::int64_t getTotalBytes() const noexcept { return totalBytes.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Sets the soft budget. 0 means unlimited.
+	 */
+	void setSoftBudgetBytes(std::int64_t bytes) noexcept
+	{
+		softBudgetBytes.store(bytes, std::memory_order_relaxed);
+	}
+
+	std::int64_t getSoftBudgetBytes() const noexcept { return softBudgetBytes.load(std::memory_order_relaxed); }
+
+	bool isOverSoftBudget() const noexcept
+	{
+		const std::int64_t budget = getSoftBudgetBytes();
+		return budget > 0 && getTotalBytes() > budget;
+	}
+
+	void logSummary(const ILogger &logger) const noexcept
+	{
+		logger.info("Memory (KiB): total={} peak={} budget={}", getTotalBytes() / 1024,
+			    peakTotalBytes.load(std::memory_order_relaxed) / 1024, getSoftBudgetBytes() / 1024);
+		for (std::size_t i = 0; i < CATEGORY_COUNT; i++) {
+			const Category category = static_cast<Category>(i);
+			logger.info("Memory {} (KiB): current={} peak={}", getCategoryName(category),
+				    getCurrentBytes(category) / 1024, getPeakBytes(category) / 1024);
+		}
+	}
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
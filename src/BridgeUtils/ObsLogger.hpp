@@ -33,12 +33,13 @@ class ObsLogger final : public ILogger {
 public:
 	ObsLogger(const char *_prefix) : prefix(_prefix) {}
 
-protected:
 	static constexpr size_t MAX_LOG_CHUNK_SIZE = 4000;
 
-	void log(LogLevel level, std::string_view message) const noexcept override
+	/**
+	 * @brief Writes a message to the OBS log, split into chunks that blog can handle.
+	 */
+	static void writeToBlog(LogLevel level, std::string_view message) noexcept
 	{
-		std::lock_guard<std::mutex> lock(mtx);
 		int blogLevel;
 		switch (level) {
 		case LogLevel::Debug:
@@ -68,6 +69,13 @@ protected:
 		}
 	}
 
+protected:
+	void log(LogLevel level, std::string_view message) const noexcept override
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		writeToBlog(level, message);
+	}
+
 protected:
 	const char *getPrefix() const noexcept override { return prefix; }
 
@@ -0,0 +1,114 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "LatencyHistogram.hpp"
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+/**
+ * @class PrometheusText
+ * @brief Builds a scrape response in the Prometheus text exposition format (version 0.0.4).
+ *
+ * Call family() once per metric name, then sample() for each label set. Labels are passed preformatted,
+ * e.g. `task="matchTimer"`, and their values must not contain quotes, backslashes or newlines.
+ */
+class PrometheusText {
+public:
+	static constexpr std::string_view CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+	/**
+	 * @brief The upper bounds of exported latency histograms, from 100 us to 10 s.
+	 */
+	static constexpr std::array<std::uint64_t, 14> LATENCY_BOUNDS_NS = {
+		100'000,    250'000,    500'000,     1'000'000,   2'500'000,   5'000'000,     10'000'000,
+		25'000'000, 50'000'000, 100'000'000, 250'000'000, 500'000'000, 1'000'000'000, 10'000'000'000,
+	};
+
+private:
+	std::string text;
+
+public:
+	void family(std::string_view name, std::string_view type, std::string_view help)
+	{
+		text.append("# HELP ").append(name).append(" ").append(help).append("\n");
+		text.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+	}
+
+	void sample(std::string_view name, std::string_view labels, std::uint64_t value)
+	{
+		appendName(name, labels);
+		text.append(std::to_string(value)).append("\n");
+	}
+
+	void sample(std::string_view name, std::string_view labels, std::int64_t value)
+	{
+		appendName(name, labels);
+		text.append(std::to_string(value)).append("\n");
+	}
+
+	void sample(std::string_view name, std::string_view labels, double value)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+		appendName(name, labels);
+		text.append(buffer).append("\n");
+	}
+
+	/**
+	 * @brief Writes a whole histogram family in seconds from a LatencyHistogram in nanoseconds.
+	 */
+	void histogram(std::string_view name, std::string_view help, const LatencyHistogram &histogram)
+	{
+		family(name, "histogram", help);
+
+		const auto cumulative = histogram.getCumulativeCounts(LATENCY_BOUNDS_NS);
+		const std::string bucketName = std::string(name) + "_bucket";
+		for (std::size_t i = 0; i < LATENCY_BOUNDS_NS.size(); i++) {
+			char le[40];
+			std::snprintf(le, sizeof(le), "le=\"%g\"", static_cast<double>(LATENCY_BOUNDS_NS[i]) / 1e9);
+			sample(bucketName, le, cumulative[i]);
+		}
+		sample(bucketName, "le=\"+Inf\"", cumulative.back());
+		sample(std::string(name) + "_sum", {}, static_cast<double>(histogram.getSumNs()) / 1e9);
+		sample(std::string(name) + "_count", {}, cumulative.back());
+	}
+
+	std::string take() noexcept { return std::move(text); }
+
+private:
+	void appendName(std::string_view name, std::string_view labels)
+	{
+		text.append(name);
+		if (!labels.empty()) {
+			text.append("{").append(labels).append("}");
+		}
+		text.append(" ");
+	}
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
@@ -18,72 +18,181 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <optional>
-#include <queue>
 #include <stdexcept>
+#include <string_view>
 #include <thread>
-#include <utility>
+#include <vector>
 
 #include "ILogger.hpp"
+#include "InplaceFunction.hpp"
+#include "LatencyHistogram.hpp"
 
 namespace KaitoTokyo {
 namespace BridgeUtils {
 
 /**
- * @brief A self-contained thread queue for executing cancellable tasks with a limit.
+ * @brief A self-contained thread pool for executing cancellable tasks with a limit.
  *
- * This class manages a single internal worker thread in an RAII style.
- * The thread is started upon object construction and safely joined upon destruction.
+ * This class manages its internal worker threads in an RAII style.
+ * The threads are started upon object construction and safely joined upon destruction.
  * If the queue is full when a new task is pushed, the oldest task is cancelled and removed.
+ *
+ * Tasks may carry a coalescing key. A keyed task replaces only the pending task with the same key,
+ * and tasks with the same key never run concurrently, so independent producers each drop only their
+ * own stale work while running side by side on different workers.
+ *
+ * Tasks live in a fixed array of slots allocated at construction, and callables are stored inline,
+ * so pushing and running tasks never allocate in the steady state.
+ *
+ * A task may carry the timestamp of the frame it analyzes and a deadline. Tasks whose deadline has passed
+ * are dropped when they would be dequeued.
+ *
+ * Per key, the queue records the queue wait, execution time and frame age of executed tasks in lock-free
+ * histograms, and counts expired, cancelled, replaced and evicted tasks. These can be read at any time
+ * through snapshot() without stopping the workers.
  */
 class ThrottledTaskQueue {
 public:
 	/**
-     * @brief A cancellation token used to safely share the cancellation state.
-     * When set to true, it indicates that the task should be cancelled.
-     */
-	using CancellationToken = std::shared_ptr<std::atomic<bool>>;
+	 * @brief The maximum size in bytes of a callable that can be pushed as a task.
+	 */
+	static constexpr std::size_t TASK_CAPACITY = 64;
+
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief The frame a task analyzes and the time after which its result is worthless.
+	 */
+	struct TaskTiming {
+		Clock::time_point frameTime;
+		Clock::time_point deadline = Clock::time_point::max();
+	};
+
+	/**
+	 * @brief A copy of the statistics of the tasks pushed with one key.
+	 */
+	struct TaskStatsSnapshot {
+		std::string_view key;
+		std::uint64_t expiredCount;
+		std::uint64_t cancelledCount;
+		std::uint64_t replacedCount;
+		std::uint64_t evictedCount;
+		LatencyHistogram::Snapshot waitNs;
+		LatencyHistogram::Snapshot execNs;
+		LatencyHistogram::Snapshot ageNs;
+	};
+
+	/**
+	 * @brief A cancellation token used to safely share the cancellation state.
+	 *
+	 * A token refers to the generation of the slot its task was placed in. The generation is advanced
+	 * whenever the task is cancelled, replaced, evicted or finished, which makes the token report cancellation.
+	 */
+	class CancellationToken {
+		friend class ThrottledTaskQueue;
+
+	private:
+		const std::atomic<std::uint64_t> *generation = nullptr;
+		std::uint64_t expected = 0;
+
+	public:
+		CancellationToken() noexcept = default;
+
+		CancellationToken(const std::atomic<std::uint64_t> *_generation, std::uint64_t _expected) noexcept
+			: generation(_generation),
+			  expected(_expected)
+		{
+		}
+
+		bool isCancelled() const noexcept
+		{
+			return !generation || generation->load(std::memory_order_acquire) != expected;
+		}
+	};
 
 	/**
-     * @brief The type of the function that can be added to the queue as a task.
-     * @param token A cancellation token unique to this task.
-     */
-	using CancellableTask = std::function<void(const CancellationToken &)>;
+	 * @brief The type of the function that can be added to the queue as a task.
+	 * @param token A cancellation token unique to this task.
+	 */
+	using CancellableTask = InplaceFunction<void(const CancellationToken &), TASK_CAPACITY>;
 
 private:
-	using QueuedTask = std::pair<std::function<void()>, CancellationToken>;
+	enum class SlotState { Free, Pending, Running };
+
+	struct TaskStats {
+		const std::string_view key;
+		std::atomic<std::uint64_t> expiredCount = 0;
+		std::atomic<std::uint64_t> cancelledCount = 0;
+		std::atomic<std::uint64_t> replacedCount = 0;
+		std::atomic<std::uint64_t> evictedCount = 0;
+		LatencyHistogram waitNs;
+		LatencyHistogram execNs;
+		LatencyHistogram ageNs;
+
+		explicit TaskStats(std::string_view _key) noexcept : key(_key) {}
+	};
+
+	struct Slot {
+		std::atomic<std::uint64_t> generation = 0;
+		SlotState state = SlotState::Free;
+		std::uint64_t sequence = 0;
+		std::string_view key;
+		TaskTiming timing;
+		Clock::time_point pushTime;
+		TaskStats *stats = nullptr;
+		CancellableTask task;
+	};
 
 	const ILogger &logger;
 	const std::size_t maxQueueSize;
-	std::thread worker;
+	const std::size_t slotCount;
+	const std::unique_ptr<Slot[]> slots;
+	const std::function<void()> onWorkerStart;
+	std::vector<std::thread> workers;
+	std::mutex statsMtx;
+	std::vector<std::unique_ptr<TaskStats>> taskStats;
 	std::mutex mtx;
 	std::condition_variable cond;
-	std::queue<QueuedTask> queue;
+	std::size_t pendingCount = 0;
+	std::uint64_t nextSequence = 0;
 	bool stopped = false;
 
 public:
 	/**
-     * @brief Constructor. Starts the worker thread.
-     * @param _logger The logger to use for internal messages.
-     * @param max_size The maximum number of tasks the queue can hold. Must be at least 1.
-     */
-	ThrottledTaskQueue(const ILogger &_logger, std::size_t _maxQueueSize)
+	 * @brief Constructor. Starts the worker threads.
+	 * @param _logger The logger to use for internal messages.
+	 * @param _maxQueueSize The maximum number of pending tasks the queue can hold. Must be at least 1.
+	 * @param workerCount The number of worker threads. Must be at least 1.
+	 * @param _onWorkerStart Called on each worker thread before it runs any task, e.g. to set its affinity.
+	 */
+	ThrottledTaskQueue(const ILogger &_logger, std::size_t _maxQueueSize, std::size_t workerCount = 1,
+			   std::function<void()> _onWorkerStart = nullptr)
 		: logger(_logger),
 		  maxQueueSize(_maxQueueSize),
-		  worker(&ThrottledTaskQueue::workerLoop, this)
+		  slotCount(_maxQueueSize + workerCount),
+		  slots(std::make_unique<Slot[]>(slotCount)),
+		  onWorkerStart(std::move(_onWorkerStart))
 	{
 		assert(_maxQueueSize > 0 && "max_size must be greater than 0");
+		assert(workerCount > 0 && "workerCount must be greater than 0");
+		workers.reserve(workerCount);
+		for (std::size_t i = 0; i < workerCount; i++) {
+			workers.emplace_back(&ThrottledTaskQueue::workerLoop, this);
+		}
 	}
 
 	/**
-     * @brief Destructor. Stops the queue and waits for the worker thread to finish.
-     */
+	 * @brief Destructor. Stops the queue and waits for the worker threads to finish.
+	 */
 	~ThrottledTaskQueue() { shutdown(); }
 
 	// Forbid copy and move semantics to keep ownership simple.
@@ -93,90 +202,222 @@ public:
 	ThrottledTaskQueue &operator=(ThrottledTaskQueue &&) = delete;
 
 	/**
-	 * @brief Stops the queue and waits for the worker thread to finish.
+	 * @brief Stops the queue and waits for the worker threads to finish.
 	 */
 	void shutdown()
 	{
-		if (worker.joinable()) {
-			stop();
-			worker.join();
+		stop();
+		for (std::thread &worker : workers) {
+			if (worker.joinable()) {
+				worker.join();
+			}
 		}
 	}
 
 	/**
-     * @brief Pushes a cancellable task to the queue.
-     * @param user_task The task to be executed. It receives a cancellation token as an argument.
-     * @return A token that can be used to cancel the task externally.
-     * @throws std::runtime_error if the queue has already been stopped.
-     */
-	CancellationToken push(CancellableTask user_task)
+	 * @brief Pushes a cancellable task to the queue.
+	 * @param task The task to be executed. It receives a cancellation token as an argument.
+	 * @return A token that can be used to cancel the task externally.
+	 * @throws std::runtime_error if the queue has already been stopped.
+	 */
+	CancellationToken push(CancellableTask task) { return push(std::string_view{}, std::move(task)); }
+
+	/**
+	 * @brief Pushes a cancellable task that replaces the pending task with the same key, if any.
+	 * @param key The coalescing key. It must refer to storage that outlives the queue, such as a string literal.
+	 *            An empty key means the task is not coalesced.
+	 * @param task The task to be executed. It receives a cancellation token as an argument.
+	 * @return A token that can be used to cancel the task externally.
+	 * @throws std::runtime_error if the queue has already been stopped.
+	 */
+	CancellationToken push(std::string_view key, CancellableTask task)
 	{
-		auto token = std::make_shared<std::atomic<bool>>(false);
+		return push(key, TaskTiming{Clock::now()}, std::move(task));
+	}
 
+	/**
+	 * @brief Pushes a keyed task that is dropped without running if it is dequeued after its deadline.
+	 * @param key The coalescing key, as for push(std::string_view, CancellableTask).
+	 * @param timing The timestamp of the analyzed frame and the deadline of the task.
+	 * @param task The task to be executed. It receives a cancellation token as an argument.
+	 * @return A token that can be used to cancel the task externally.
+	 * @throws std::runtime_error if the queue has already been stopped.
+	 */
+	CancellationToken push(std::string_view key, TaskTiming timing, CancellableTask task)
+	{
+		CancellationToken token;
 		{
 			std::lock_guard<std::mutex> lock(mtx);
 			if (stopped) {
 				throw std::runtime_error("push on stopped ThrottledTaskQueue");
 			}
 
-			// If the queue is full, cancel and remove the oldest task.
-			while (queue.size() >= maxQueueSize) {
-				if (queue.front().second) {
-					queue.front().second->store(true); // Cancel
+			Slot *slot = key.empty() ? nullptr : findPending(key);
+			if (slot) {
+				// Latest wins: the stale task keeps its place in line but is replaced.
+				slot->generation.fetch_add(1, std::memory_order_release);
+				slot->stats->replacedCount.fetch_add(1, std::memory_order_relaxed);
+			} else {
+				// If the queue is full, cancel and remove the oldest task.
+				if (pendingCount >= maxQueueSize) {
+					Slot &oldest = *findOldestPending();
+					oldest.stats->evictedCount.fetch_add(1, std::memory_order_relaxed);
+					release(oldest);
 				}
-				queue.pop();
+				slot = findFree();
+				slot->state = SlotState::Pending;
+				slot->sequence = nextSequence++;
+				pendingCount++;
 			}
-			queue.push({[user_task, token] { user_task(token); }, token});
+
+			slot->key = key;
+			slot->timing = timing;
+			slot->pushTime = Clock::now();
+			slot->stats = getTaskStats(key);
+			slot->task = std::move(task);
+			token = CancellationToken(&slot->generation, slot->generation.load(std::memory_order_relaxed));
 		}
-		cond.notify_one();
+		cond.notify_all();
 		return token;
 	}
 
+	/**
+	 * @brief Cancels a task. A pending task is removed; a running task observes the cancellation through its token.
+	 */
+	void cancel(const CancellationToken &token)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (std::size_t i = 0; i < slotCount; i++) {
+			Slot &slot = slots[i];
+			if (slot.state == SlotState::Free || !isTokenOf(token, slot)) {
+				continue;
+			}
+			slot.stats->cancelledCount.fetch_add(1, std::memory_order_relaxed);
+			if (slot.state == SlotState::Pending) {
+				release(slot);
+			} else {
+				slot.generation.fetch_add(1, std::memory_order_release);
+			}
+			return;
+		}
+	}
+
+	/**
+	 * @brief Copies the statistics of every key. Safe to call from any thread while the workers run.
+	 */
+	std::vector<TaskStatsSnapshot> snapshot()
+	{
+		std::lock_guard<std::mutex> lock(statsMtx);
+		std::vector<TaskStatsSnapshot> result;
+		result.reserve(taskStats.size());
+		for (const std::unique_ptr<TaskStats> &stats : taskStats) {
+			result.push_back({stats->key, stats->expiredCount.load(std::memory_order_relaxed),
+					  stats->cancelledCount.load(std::memory_order_relaxed),
+					  stats->replacedCount.load(std::memory_order_relaxed),
+					  stats->evictedCount.load(std::memory_order_relaxed), stats->waitNs.snapshot(),
+					  stats->execNs.snapshot(), stats->ageNs.snapshot()});
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Logs the statistics of every key.
+	 */
+	void logSummary(const ILogger &summaryLogger)
+	{
+		for (const TaskStatsSnapshot &stats : snapshot()) {
+			const std::string_view key = stats.key.empty() ? "(unkeyed)" : stats.key;
+			summaryLogger.info("Task {}: expired={} cancelled={} replaced={} evicted={}", key,
+					   stats.expiredCount, stats.cancelledCount, stats.replacedCount,
+					   stats.evictedCount);
+			logHistogram(summaryLogger, key, "wait", stats.waitNs);
+			logHistogram(summaryLogger, key, "exec", stats.execNs);
+			logHistogram(summaryLogger, key, "age", stats.ageNs);
+		}
+	}
+
 private:
 	/**
-     * @brief The main loop for the worker thread.
-     */
+	 * @brief The main loop for each worker thread.
+	 */
 	void workerLoop()
 	{
+		if (onWorkerStart) {
+			onWorkerStart();
+		}
+
 		while (true) {
-			std::optional<std::function<void()>> taskOpt = pop();
-			if (!taskOpt) {
+			CancellationToken token;
+			Slot *slot = pop(token);
+			if (!slot) {
 				break;
 			}
 
+			const bool keyed = !slot->key.empty();
+			const Clock::time_point startTime = Clock::now();
 			try {
-				(*taskOpt)();
+				slot->task(token);
 			} catch (const std::exception &e) {
 				logger.error("ThrottledTaskQueue: Task threw an exception: {}", e.what());
 			} catch (...) {
 				logger.error("ThrottledTaskQueue: Task threw an unknown exception.");
 			}
+			slot->stats->execNs.record(toNanoseconds(Clock::now() - startTime));
+
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				slot->task.reset();
+				slot->generation.fetch_add(1, std::memory_order_release);
+				slot->state = SlotState::Free;
+			}
+			if (keyed) {
+				// A worker may be waiting for this key to finish.
+				cond.notify_all();
+			}
 		}
 	}
 
 	/**
-     * @brief Pops a task from the queue. Waits if the queue is empty.
-     * @return The task to be executed, or std::nullopt if the queue is stopped and empty.
-     */
-	std::optional<std::function<void()>> pop()
+	 * @brief Claims the oldest pending task whose key is not already running. Waits if there is none.
+	 * Expired tasks met on the way are dropped without running.
+	 * @param token Receives the cancellation token of the claimed task.
+	 * @return The slot of the task to be executed, or nullptr if the queue is stopped.
+	 */
+	Slot *pop(CancellationToken &token)
 	{
 		std::unique_lock<std::mutex> lock(mtx);
-		cond.wait(lock, [this] { return !queue.empty() || stopped; });
 
-		if (stopped && queue.empty()) {
-			return std::nullopt;
-		}
+		while (!stopped) {
+			Slot *runnable = findOldestRunnable();
+			if (!runnable) {
+				cond.wait(lock);
+				continue;
+			}
+
+			const Clock::time_point now = Clock::now();
+			if (now > runnable->timing.deadline) {
+				runnable->stats->expiredCount.fetch_add(1, std::memory_order_relaxed);
+				release(*runnable);
+				continue;
+			}
 
-		auto task_pair = std::move(queue.front());
-		queue.pop();
+			runnable->stats->waitNs.record(toNanoseconds(now - runnable->pushTime));
+			runnable->stats->ageNs.record(toNanoseconds(now - runnable->timing.frameTime));
 
-		return std::move(task_pair.first);
+			runnable->state = SlotState::Running;
+			pendingCount--;
+			token = CancellationToken(&runnable->generation,
+						  runnable->generation.load(std::memory_order_relaxed));
+			return runnable;
+		}
+
+		return nullptr;
 	}
 
 	/**
-     * @brief Stops the queue.
-     * Stops accepting new tasks and signals cancellation to all pending tasks in the queue.
-     */
+	 * @brief Stops the queue.
+	 * Stops accepting new tasks and signals cancellation to all pending tasks in the queue.
+	 */
 	void stop()
 	{
 		{
@@ -187,15 +428,114 @@ private:
 			stopped = true;
 
 			// Cancel all pending tasks in the queue before shutting down.
-			while (!queue.empty()) {
-				if (queue.front().second) {
-					queue.front().second->store(true);
+			for (std::size_t i = 0; i < slotCount; i++) {
+				if (slots[i].state == SlotState::Pending) {
+					slots[i].stats->cancelledCount.fetch_add(1, std::memory_order_relaxed);
+					release(slots[i]);
 				}
-				queue.pop();
 			}
 		}
 		cond.notify_all();
 	}
+
+	void release(Slot &slot) noexcept
+	{
+		slot.generation.fetch_add(1, std::memory_order_release);
+		slot.task.reset();
+		slot.state = SlotState::Free;
+		pendingCount--;
+	}
+
+	TaskStats *getTaskStats(std::string_view key)
+	{
+		std::lock_guard<std::mutex> lock(statsMtx);
+		for (const std::unique_ptr<TaskStats> &stats : taskStats) {
+			if (stats->key == key) {
+				return stats.get();
+			}
+		}
+		// Only the first task of each key allocates.
+		return taskStats.emplace_back(std::make_unique<TaskStats>(key)).get();
+	}
+
+	static std::uint64_t toNanoseconds(Clock::duration duration) noexcept
+	{
+		const std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+		return static_cast<std::uint64_t>(std::max<std::int64_t>(0, ns));
+	}
+
+	static void logHistogram(const ILogger &summaryLogger, std::string_view key, const char *name,
+				 const LatencyHistogram::Snapshot &s) noexcept
+	{
+		if (s.count == 0) {
+			return;
+		}
+		summaryLogger.info("Task {} {} (ms): n={} mean={:.2f} p50={:.2f} p95={:.2f} p99={:.2f} max={:.2f}", key,
+				   name, s.count, s.getMeanNs() / 1e6, s.p50Ns / 1e6, s.p95Ns / 1e6, s.p99Ns / 1e6,
+				   s.maxNs / 1e6);
+	}
+
+	static bool isTokenOf(const CancellationToken &token, const Slot &slot) noexcept
+	{
+		return token.generation == &slot.generation &&
+		       token.expected == slot.generation.load(std::memory_order_relaxed);
+	}
+
+	Slot *findFree() noexcept
+	{
+		for (std::size_t i = 0; i < slotCount; i++) {
+			if (slots[i].state == SlotState::Free) {
+				return &slots[i];
+			}
+		}
+		return nullptr;
+	}
+
+	Slot *findPending(std::string_view key) noexcept
+	{
+		for (std::size_t i = 0; i < slotCount; i++) {
+			if (slots[i].state == SlotState::Pending && slots[i].key == key) {
+				return &slots[i];
+			}
+		}
+		return nullptr;
+	}
+
+	Slot *findOldestPending() noexcept
+	{
+		Slot *oldest = nullptr;
+		for (std::size_t i = 0; i < slotCount; i++) {
+			if (slots[i].state == SlotState::Pending && (!oldest || slots[i].sequence < oldest->sequence)) {
+				oldest = &slots[i];
+			}
+		}
+		return oldest;
+	}
+
+	Slot *findOldestRunnable() noexcept
+	{
+		Slot *oldest = nullptr;
+		for (std::size_t i = 0; i < slotCount; i++) {
+			Slot &slot = slots[i];
+			if (slot.state != SlotState::Pending || (oldest && slot.sequence > oldest->sequence)) {
+				continue;
+			}
+			if (slot.key.empty() || !isRunning(slot.key)) {
+				oldest = &slot;
+			}
+		}
+		return oldest;
+	}
+
+	bool isRunning(std::string_view key) const noexcept
+	{
+		for (std::size_t i = 0; i < slotCount; i++) {
+			if (slots[i].state == SlotState::Running && slots[i].key == key) {
+				return true;
+			}
+		}
+		return false;
+	}
 };
 
 } // namespace BridgeUtils
@@ -0,0 +1,244 @@
+/*
+Bridge Utils
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace KaitoTokyo {
+namespace BridgeUtils {
+
+/**
+ * @class TraceRecorder
+ * @brief Records named spans from any thread and dumps them as a Chrome trace event JSON file.
+ *
+ * Each thread writes complete events into its own fixed-size ring, so recording never takes a lock or
+ * allocates once the thread's ring exists. When tracing is disabled, a span costs one relaxed atomic load.
+ * The resulting file can be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Span and thread names must be string literals or otherwise outlive the recorder.
+ */
+class TraceRecorder {
+public:
+	static constexpr std::size_t EVENTS_PER_THREAD = 8192;
+
+private:
+	struct Event {
+		// Odd while the owning thread is writing the event, see ThreadBuffer::write().
+		std::atomic<std::uint64_t> sequence = 0;
+		std::atomic<const char *> name = nullptr;
+		std::atomic<std::int64_t> beginNs = 0;
+		std::atomic<std::int64_t> durationNs = 0;
+	};
+
+	struct ThreadBuffer {
+		const std::uint32_t tid;
+		std::atomic<const char *> threadName = nullptr;
+		std::atomic<bool> retired = false;
+		std::uint64_t writeCount = 0;
+		const std::unique_ptr<Event[]> events = std::make_unique<Event[]>(EVENTS_PER_THREAD);
+
+		explicit ThreadBuffer(std::uint32_t _tid) : tid(_tid) {}
+
+		void write(const char *name, std::int64_t beginNs, std::int64_t durationNs) noexcept
+		{
+			Event &event = events[writeCount % EVENTS_PER_THREAD];
+			const std::uint64_t sequence = writeCount * 2 + 1;
+			event.sequence.store(sequence, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			event.name.store(name, std::memory_order_relaxed);
+			event.beginNs.store(beginNs, std::memory_order_relaxed);
+			event.durationNs.store(durationNs, std::memory_order_relaxed);
+			event.sequence.store(sequence + 1, std::memory_order_release);
+			writeCount++;
+		}
+	};
+
+	struct ThreadHolder {
+		std::shared_ptr<ThreadBuffer> buffer;
+		const char *pendingName = nullptr;
+
+		~ThreadHolder()
+		{
+			if (buffer) {
+				buffer->retired.store(true, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	std::atomic<bool> enabled = false;
+	std::mutex mtx;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	std::uint32_t nextTid = 1;
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	static ThreadHolder &getThreadHolder()
+	{
+		static thread_local ThreadHolder holder;
+		return holder;
+	}
+
+	TraceRecorder() = default;
+
+public:
+	static TraceRecorder &instance()
+	{
+		static TraceRecorder recorder;
+		return recorder;
+	}
+
+	TraceRecorder(const TraceRecorder &) = delete;
+	TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+	void setEnabled(bool value) noexcept { enabled.store(value, std::memory_order_relaxed); }
+
+	bool isEnabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Names the calling thread in the trace. Does not allocate until the thread records a span.
+	 */
+	static void setThreadName(const char *name) noexcept
+	{
+		ThreadHolder &holder = getThreadHolder();
+		holder.pendingName = name;
+		if (holder.buffer) {
+			holder.buffer->threadName.store(name, std::memory_order_relaxed);
+		}
+	}
+
+	std::int64_t now() const noexcept
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch)
+			.count();
+	}
+
+	void record(const char *name, std::int64_t beginNs, std::int64_t endNs) noexcept
+	{
+		ThreadHolder &holder = getThreadHolder();
+		if (!holder.buffer) {
+			try {
+				std::lock_guard<std::mutex> lock(mtx);
+				holder.buffer = std::make_shared<ThreadBuffer>(nextTid++);
+				holder.buffer->threadName.store(holder.pendingName, std::memory_order_relaxed);
+				buffers.push_back(holder.buffer);
+			} catch (...) {
+				holder.buffer.reset();
+				return;
+			}
+		}
+		holder.buffer->write(name, beginNs, endNs - beginNs);
+	}
+
+	/**
+	 * @brief Writes the events currently held by every thread ring to a Chrome trace event JSON file.
+	 * Recording continues while the file is written. Rings of exited threads are released afterwards.
+	 * @return Whether the file was written.
+	 */
+	bool dump(const char *path)
+	{
+		std::vector<std::shared_ptr<ThreadBuffer>> snapshot;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			snapshot = buffers;
+		}
+
+		std::unique_ptr<std::FILE, decltype(&std::fclose)> file(std::fopen(path, "w"), &std::fclose);
+		if (!file) {
+			return false;
+		}
+
+		std::fputs("{\"traceEvents\":[\n", file.get());
+		bool first = true;
+		for (const std::shared_ptr<ThreadBuffer> &buffer : snapshot) {
+			const char *threadName = buffer->threadName.load(std::memory_order_relaxed);
+			std::fprintf(file.get(),
+				     "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+				     "\"args\":{\"name\":\"%s\"}}",
+				     first ? "" : ",\n", buffer->tid, threadName ? threadName : "thread");
+			first = false;
+
+			for (std::size_t i = 0; i < EVENTS_PER_THREAD; i++) {
+				const Event &event = buffer->events[i];
+				const std::uint64_t before = event.sequence.load(std::memory_order_acquire);
+				const char *name = event.name.load(std::memory_order_relaxed);
+				const std::int64_t beginNs = event.beginNs.load(std::memory_order_relaxed);
+				const std::int64_t durationNs = event.durationNs.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				const std::uint64_t after = event.sequence.load(std::memory_order_relaxed);
+				if (before == 0 || before != after || (before & 1) || !name) {
+					continue;
+				}
+				std::fprintf(file.get(),
+					     ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+					     "\"ts\":%.3f,\"dur\":%.3f}",
+					     name, buffer->tid, beginNs / 1e3, durationNs / 1e3);
+			}
+		}
+		std::fputs("\n]}\n", file.get());
+		const bool written = std::ferror(file.get()) == 0;
+
+		std::lock_guard<std::mutex> lock(mtx);
+		std::vector<std::shared_ptr<ThreadBuffer>> live;
+		for (std::shared_ptr<ThreadBuffer> &buffer : buffers) {
+			if (!buffer->retired.load(std::memory_order_relaxed)) {
+				live.push_back(std::move(buffer));
+			}
+		}
+		buffers = std::move(live);
+		return written;
+	}
+};
+
+/**
+ * @brief Records a span from construction to destruction while tracing is enabled.
+ */
+class TraceScope {
+private:
+	const char *const name;
+	std::int64_t beginNs = -1;
+
+public:
+	explicit TraceScope(const char *_name) noexcept : name(_name)
+	{
+		TraceRecorder &recorder = TraceRecorder::instance();
+		if (recorder.isEnabled()) {
+			beginNs = recorder.now();
+		}
+	}
+
+	~TraceScope() noexcept
+	{
+		if (beginNs >= 0) {
+			TraceRecorder &recorder = TraceRecorder::instance();
+			recorder.record(name, beginNs, recorder.now());
+		}
+	}
+
+	TraceScope(const TraceScope &) = delete;
+	TraceScope &operator=(const TraceScope &) = delete;
+};
+
+} // namespace BridgeUtils
+} // namespace KaitoTokyo
@@ -0,0 +1,190 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief Decides on which capture ticks each analyzer runs.
+ *
+ * The scheduler derives a capture clock from the captureFps property, independent of the canvas frame rate.
+ * Every analyzer runs at its own rate, expressed as a whole number of capture ticks, and heavy analyzers are
+ * given phase offsets so that they avoid landing on the same tick whenever their periods allow it.
+ * Analyzers whose results nobody consumes can be disabled, and a re-enabled analyzer is due on the very next
+ * capture tick so that its first result does not wait for its phase.
+ *
+ * This class is not thread-safe. It is meant to be driven from the video tick only.
+ */
+class AnalysisScheduler {
+public:
+	using AnalyzerId = std::uint32_t;
+	using AnalyzerMask = std::uint32_t;
+
+	static constexpr AnalyzerId MAX_ANALYZERS = 32;
+
+private:
+	struct Analyzer {
+		double rateHz;
+		bool heavy;
+		std::uint64_t periodTicks;
+		std::uint64_t phaseTicks;
+		bool enabled;
+		bool runNext;
+	};
+
+	std::vector<Analyzer> analyzers;
+	int captureFps;
+	double accumulatedSeconds = 0.0;
+	std::uint64_t captureTick = 0;
+
+public:
+	explicit AnalysisScheduler(int _captureFps) : captureFps(std::max(1, _captureFps)) {}
+
+	static constexpr AnalyzerMask toMask(AnalyzerId id) noexcept { return AnalyzerMask{1} << id; }
+
+	/**
+	 * @brief Registers an analyzer.
+	 * @param rateHz The desired analysis rate. Zero or a rate above captureFps means every capture tick.
+	 * @param heavy Whether the analyzer should be kept off the ticks of other heavy analyzers.
+	 * @return The identifier whose bit is set in the masks returned by tick().
+	 */
+	AnalyzerId addAnalyzer(double rateHz, bool heavy)
+	{
+		if (analyzers.size() >= MAX_ANALYZERS) {
+			throw std::runtime_error("Too many analyzers registered to AnalysisScheduler");
+		}
+		analyzers.push_back({rateHz, heavy, 1, 0, true, false});
+		assignPhases();
+		return static_cast<AnalyzerId>(analyzers.size() - 1);
+	}
+
+	int getCaptureFps() const noexcept { return captureFps; }
+
+	/**
+	 * @brief Turns an analyzer on or off. A disabled analyzer is never due.
+	 */
+	void setEnabled(AnalyzerId id, bool enabled)
+	{
+		Analyzer &analyzer = analyzers.at(id);
+		if (analyzer.enabled == enabled) {
+			return;
+		}
+		analyzer.enabled = enabled;
+		analyzer.runNext = enabled;
+	}
+
+	bool isEnabled(AnalyzerId id) const { return analyzers.at(id).enabled; }
+
+	void setCaptureFps(int _captureFps)
+	{
+		_captureFps = std::max(1, _captureFps);
+		if (_captureFps == captureFps) {
+			return;
+		}
+		captureFps = _captureFps;
+		accumulatedSeconds = 0.0;
+		captureTick = 0;
+		assignPhases();
+	}
+
+	/**
+	 * @brief Advances the capture clock by one video tick.
+	 * @param seconds The time elapsed since the previous video tick.
+	 * @return The analyzers due on this video tick, or zero when no capture tick falls on it.
+	 */
+	AnalyzerMask tick(float seconds) noexcept
+	{
+		const double interval = 1.0 / captureFps;
+
+		accumulatedSeconds += seconds;
+		if (accumulatedSeconds < interval * 0.999) {
+			return 0;
+		}
+		// Never burst to catch up after a stall; just restart the clock.
+		accumulatedSeconds = std::min(accumulatedSeconds - interval, interval);
+
+		AnalyzerMask due = 0;
+		for (std::size_t i = 0; i < analyzers.size(); i++) {
+			Analyzer &analyzer = analyzers[i];
+			if (!analyzer.enabled) {
+				continue;
+			}
+			if (analyzer.runNext || captureTick % analyzer.periodTicks == analyzer.phaseTicks) {
+				due |= toMask(static_cast<AnalyzerId>(i));
+				analyzer.runNext = false;
+			}
+		}
+		captureTick++;
+		return due;
+	}
+
+private:
+	std::uint64_t computePeriodTicks(double rateHz) const noexcept
+	{
+		if (rateHz <= 0.0 || rateHz >= captureFps) {
+			return 1;
+		}
+		return std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::llround(captureFps / rateHz)));
+	}
+
+	void assignPhases() noexcept
+	{
+		for (std::size_t i = 0; i < analyzers.size(); i++) {
+			Analyzer &analyzer = analyzers[i];
+			analyzer.periodTicks = computePeriodTicks(analyzer.rateHz);
+			analyzer.phaseTicks = 0;
+			if (!analyzer.heavy) {
+				continue;
+			}
+
+			// Two analyzers with periods p and q and phases a and b collide at some tick
+			// if and only if a - b is divisible by gcd(p, q).
+			std::size_t bestCollisions = std::numeric_limits<std::size_t>::max();
+			for (std::uint64_t phase = 0; phase < analyzer.periodTicks; phase++) {
+				std::size_t collisions = 0;
+				for (std::size_t j = 0; j < i; j++) {
+					const Analyzer &other = analyzers[j];
+					if (!other.heavy) {
+						continue;
+					}
+					const std::uint64_t g = std::gcd(analyzer.periodTicks, other.periodTicks);
+					if ((phase + g - other.phaseTicks % g) % g == 0) {
+						collisions++;
+					}
+				}
+				if (collisions < bestCollisions) {
+					bestCollisions = collisions;
+					analyzer.phaseTicks = phase;
+				}
+			}
+		}
+	}
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
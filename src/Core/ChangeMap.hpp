@@ -0,0 +1,176 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "AnalysisScheduler.hpp"
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief Tracks which analyzers have seen a change in their region since they last ran.
+ *
+ * The change map is a TILES_X x TILES_Y grid of per-tile differences between consecutive change-detector frames,
+ * read back from the GPU. Each watched analyzer covers a rectangle of tiles and adds up their differences since
+ * it last ran, so a slow fade or pan that stays under the threshold on every tick still makes it dirty. An
+ * analyzer also becomes dirty once maxSkipInterval has passed since it last ran, which bounds how stale a
+ * result can get when a change is too faint to detect. Analyzers that are not watched are always dirty.
+ *
+ * This class is not thread-safe. It is meant to be used from the render thread only.
+ */
+class ChangeMap {
+public:
+	static constexpr std::uint32_t TILES_X = 32;
+	static constexpr std::uint32_t TILES_Y = 18;
+
+	using Clock = std::chrono::steady_clock;
+
+private:
+	struct Watch {
+		AnalysisScheduler::AnalyzerMask mask;
+		std::uint32_t tileLeft;
+		std::uint32_t tileTop;
+		std::uint32_t tileRight;
+		std::uint32_t tileBottom;
+		std::uint32_t threshold;
+		/** The summed differences of the tiles in the rectangle since the analyzer last ran, row by row. */
+		std::vector<std::uint32_t> accumulated;
+		Clock::time_point lastTaken;
+		bool dirty;
+	};
+
+	const std::uint32_t sourceWidth;
+	const std::uint32_t sourceHeight;
+	const Clock::duration maxSkipInterval;
+	std::vector<Watch> watches;
+	std::uint32_t changedTileCount = 0;
+
+public:
+	ChangeMap(std::uint32_t _sourceWidth, std::uint32_t _sourceHeight, Clock::duration _maxSkipInterval)
+		: sourceWidth(_sourceWidth),
+		  sourceHeight(_sourceHeight),
+		  maxSkipInterval(_maxSkipInterval)
+	{
+	}
+
+	/**
+	 * @brief Gates an analyzer on changes inside a region of the source.
+	 * @param threshold The summed per-tile difference above which the analyzer runs again.
+	 */
+	void watch(AnalysisScheduler::AnalyzerId analyzer, std::uint32_t x, std::uint32_t y, std::uint32_t width,
+		   std::uint32_t height, std::uint8_t threshold)
+	{
+		Watch w;
+		w.mask = AnalysisScheduler::toMask(analyzer);
+		w.tileLeft = std::min(TILES_X - 1, x * TILES_X / sourceWidth);
+		w.tileTop = std::min(TILES_Y - 1, y * TILES_Y / sourceHeight);
+		w.tileRight = static_cast<std::uint32_t>(std::clamp<std::uint64_t>(
+			(static_cast<std::uint64_t>(x + width) * TILES_X + sourceWidth - 1) / sourceWidth,
+			w.tileLeft + 1, TILES_X));
+		w.tileBottom = static_cast<std::uint32_t>(std::clamp<std::uint64_t>(
+			(static_cast<std::uint64_t>(y + height) * TILES_Y + sourceHeight - 1) / sourceHeight,
+			w.tileTop + 1, TILES_Y));
+		w.threshold = threshold;
+		const std::size_t tileCount =
+			static_cast<std::size_t>(w.tileRight - w.tileLeft) * (w.tileBottom - w.tileTop);
+		w.accumulated.assign(tileCount, 0);
+		w.dirty = true;
+		watches.push_back(std::move(w));
+	}
+
+	/**
+	 * @brief Accumulates a change map read back from the GPU.
+	 * @param data The TILES_X x TILES_Y single channel change map.
+	 * @param linesize The stride of data in bytes.
+	 * @param threshold The per-tile difference above which a tile counts as changed in getChangedTileCount().
+	 */
+	void update(const std::uint8_t *data, std::uint32_t linesize, std::uint8_t threshold) noexcept
+	{
+		changedTileCount = 0;
+		for (std::uint32_t y = 0; y < TILES_Y; y++) {
+			for (std::uint32_t x = 0; x < TILES_X; x++) {
+				if (data[y * linesize + x] > threshold) {
+					changedTileCount++;
+				}
+			}
+		}
+
+		for (Watch &w : watches) {
+			if (w.dirty) {
+				continue;
+			}
+			std::uint32_t *accumulated = w.accumulated.data();
+			for (std::uint32_t y = w.tileTop; y < w.tileBottom; y++) {
+				for (std::uint32_t x = w.tileLeft; x < w.tileRight; x++, accumulated++) {
+					*accumulated += data[y * linesize + x];
+					if (*accumulated > w.threshold) {
+						w.dirty = true;
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Makes a watched analyzer run on its next due tick even if its region has not changed.
+	 */
+	void markDirty(AnalysisScheduler::AnalyzerId analyzer) noexcept
+	{
+		for (Watch &w : watches) {
+			if (w.mask & AnalysisScheduler::toMask(analyzer)) {
+				w.dirty = true;
+			}
+		}
+	}
+
+	/**
+	 * @brief Removes watched analyzers whose region has not changed since they last ran, unless they have
+	 * been skipped for maxSkipInterval.
+	 * @return The subset of analyzers that should run, which are marked clean again.
+	 */
+	AnalysisScheduler::AnalyzerMask takeChanged(AnalysisScheduler::AnalyzerMask analyzers,
+						    Clock::time_point now) noexcept
+	{
+		for (Watch &w : watches) {
+			if (!(analyzers & w.mask)) {
+				continue;
+			}
+			if (w.dirty || now - w.lastTaken >= maxSkipInterval) {
+				w.dirty = false;
+				std::fill(w.accumulated.begin(), w.accumulated.end(), 0);
+				w.lastTaken = now;
+			} else {
+				analyzers &= ~w.mask;
+			}
+		}
+		return analyzers;
+	}
+
+	std::uint32_t getChangedTileCount() const noexcept { return changedTileCount; }
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
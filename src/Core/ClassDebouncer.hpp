@@ -0,0 +1,104 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief Stabilizes a stream of per-class scores into a class that only changes deliberately.
+ *
+ * A challenger replaces the current class only when its score beats the current class by a margin
+ * (hysteresis) on a number of consecutive inferences (debounce). This keeps the overlay from flickering
+ * between two classes whose scores are close.
+ *
+ * This class is not thread-safe. Callers must serialize update().
+ */
+class ClassDebouncer {
+private:
+	const float margin;
+	const int confirmations;
+
+	std::size_t currentClass = NO_CLASS;
+	std::size_t candidateClass = NO_CLASS;
+	int candidateCount = 0;
+
+public:
+	static constexpr std::size_t NO_CLASS = static_cast<std::size_t>(-1);
+
+	/**
+	 * @param _margin How much the challenger's score must exceed the current class's score.
+	 * @param _confirmations How many consecutive inferences the challenger must win.
+	 */
+	ClassDebouncer(float _margin, int _confirmations)
+		: margin(_margin),
+		  confirmations(std::max(1, _confirmations))
+	{
+	}
+
+	/**
+	 * @brief Feeds the scores of one inference.
+	 * @return Whether the current class changed.
+	 */
+	bool update(const std::vector<float> &scores) noexcept
+	{
+		if (scores.empty()) {
+			return false;
+		}
+
+		const auto topIt = std::max_element(scores.begin(), scores.end());
+		const auto top = static_cast<std::size_t>(std::distance(scores.begin(), topIt));
+
+		if (currentClass == NO_CLASS || currentClass >= scores.size()) {
+			currentClass = top;
+			candidateClass = NO_CLASS;
+			candidateCount = 0;
+			return true;
+		}
+
+		if (top == currentClass || *topIt < scores[currentClass] + margin) {
+			candidateClass = NO_CLASS;
+			candidateCount = 0;
+			return false;
+		}
+
+		if (top != candidateClass) {
+			candidateClass = top;
+			candidateCount = 0;
+		}
+		if (++candidateCount < confirmations) {
+			return false;
+		}
+
+		currentClass = top;
+		candidateClass = NO_CLASS;
+		candidateCount = 0;
+		return true;
+	}
+
+	std::size_t getCurrentClass() const noexcept { return currentClass; }
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -0,0 +1,201 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "CpuBudget.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+#include <ncnn/cpu.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <pthread/qos.h>
+#else
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+void CpuBudget::Lease::reset() noexcept
+{
+	if (budget) {
+		budget->release(threads);
+		budget = nullptr;
+		threads = 0;
+	}
+}
+
+CpuBudget::CpuBudget()
+{
+	configure(Config{});
+}
+
+CpuBudget &CpuBudget::instance()
+{
+	static CpuBudget budget;
+	return budget;
+}
+
+CpuBudget::Config CpuBudget::loadConfig(const char *path)
+{
+	Config config;
+
+	std::ifstream file(path);
+	if (!file) {
+		return config;
+	}
+
+	const json j = json::parse(file, nullptr, false);
+	if (j.is_discarded() || !j.is_object()) {
+		throw std::runtime_error("Failed to parse CPU budget configuration");
+	}
+
+	config.maxAnalysisThreads = j.value("maxAnalysisThreads", config.maxAnalysisThreads);
+	config.workersPerFilter = std::max(1, j.value("workersPerFilter", config.workersPerFilter));
+	config.ncnnThreadsPerNet = std::max(1, j.value("ncnnThreadsPerNet", config.ncnnThreadsPerNet));
+	config.preferPerformanceCores = j.value("preferPerformanceCores", config.preferPerformanceCores);
+	config.lowerPriority = j.value("lowerPriority", config.lowerPriority);
+	if (j.contains("cpuAffinity") && j["cpuAffinity"].is_array()) {
+		for (const json &cpu : j["cpuAffinity"]) {
+			config.cpuAffinity.push_back(cpu.get<int>());
+		}
+	}
+
+	return config;
+}
+
+void CpuBudget::configure(const Config &newConfig)
+{
+	const int cpuCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	std::vector<int> cpus;
+	for (int cpu : newConfig.cpuAffinity) {
+		if (cpu >= 0 && cpu < cpuCount) {
+			cpus.push_back(cpu);
+		}
+	}
+
+	// Only the set of cores is decided here. configure() runs on the thread that loads the module, so changing
+	// affinity or ncnn's process-wide power-save mode here would pin OBS itself. The analysis threads pin
+	// themselves in applyToCurrentThread().
+	if (cpus.empty() && newConfig.preferPerformanceCores && ncnn::get_big_cpu_count() < ncnn::get_cpu_count()) {
+		// Hybrid CPU: ncnn already tells big cores apart by their maximum frequency.
+		const ncnn::CpuSet &bigCores = ncnn::get_cpu_thread_affinity_mask(2);
+		for (int cpu = 0; cpu < ncnn::get_cpu_count(); cpu++) {
+			if (bigCores.is_enabled(cpu)) {
+				cpus.push_back(cpu);
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mtx);
+	config = newConfig;
+	maxThreads = newConfig.maxAnalysisThreads > 0 ? newConfig.maxAnalysisThreads : std::max(1, cpuCount / 4);
+	pinnedCpus = std::move(cpus);
+}
+
+CpuBudget::Lease CpuBudget::acquire(int requested)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	const int granted = std::clamp(maxThreads - leasedThreads, 1, std::max(1, requested));
+	leasedThreads += granted;
+	peakLeasedThreads = std::max(peakLeasedThreads, leasedThreads);
+	return Lease(this, granted);
+}
+
+void CpuBudget::release(int threads) noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	leasedThreads -= threads;
+}
+
+CpuBudget::Config CpuBudget::getConfig() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return config;
+}
+
+void CpuBudget::applyToCurrentThread() const noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+#ifdef _WIN32
+	DWORD_PTR affinityMask = 0;
+	for (int cpu : pinnedCpus) {
+		if (cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+			affinityMask |= DWORD_PTR{1} << cpu;
+		}
+	}
+	if (affinityMask != 0) {
+		SetThreadAffinityMask(GetCurrentThread(), affinityMask);
+	}
+	if (config.lowerPriority) {
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+	}
+#elif defined(__APPLE__)
+	// macOS has no thread affinity API; QoS steers scheduling and core selection instead.
+	if (config.lowerPriority) {
+		pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+	}
+#else
+	if (!pinnedCpus.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : pinnedCpus) {
+			CPU_SET(cpu, &set);
+		}
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+	if (config.lowerPriority) {
+		// On Linux the nice value is per thread.
+		setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+	}
+#endif
+}
+
+void CpuBudget::logSummary(const BridgeUtils::ILogger &logger) const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	std::string cpus;
+	for (int cpu : pinnedCpus) {
+		cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+	}
+
+	logger.info("CPU budget: maxAnalysisThreads={} workersPerFilter={} ncnnThreadsPerNet={} affinity={} "
+		    "lowerPriority={} leased={} peak={}",
+		    maxThreads, config.workersPerFilter, config.ncnnThreadsPerNet, cpus.empty() ? "none" : cpus,
+		    config.lowerPriority, leasedThreads, peakLeasedThreads);
+}
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -0,0 +1,141 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "BridgeUtils/ILogger.hpp"
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief The process-wide budget of CPU threads spent on analysis by all filter instances.
+ *
+ * Task queue workers and ncnn threads are leased from a single cap so that several filters do not
+ * oversubscribe the machine on top of the OBS encoder and compositor threads. Analysis threads can
+ * optionally be pinned to a set of cores and run at a lowered scheduling priority.
+ *
+ * The budget is configured once at module load from cpu-budget.json in the module config directory.
+ */
+class CpuBudget {
+public:
+	struct Config {
+		/** @brief The total number of analysis threads. 0 picks a quarter of the logical CPUs. */
+		int maxAnalysisThreads = 0;
+		int workersPerFilter = 2;
+		int ncnnThreadsPerNet = 2;
+		/** @brief The logical CPUs analysis threads are pinned to. Empty means no explicit pinning. */
+		std::vector<int> cpuAffinity;
+		/** @brief Pins analysis threads to the performance cores of hybrid CPUs when no affinity is given. */
+		bool preferPerformanceCores = false;
+		bool lowerPriority = true;
+	};
+
+	/**
+	 * @brief A number of threads taken from the budget and returned on destruction.
+	 */
+	class Lease {
+	private:
+		CpuBudget *budget;
+		int threads;
+
+	public:
+		Lease() noexcept : budget(nullptr), threads(0) {}
+		Lease(CpuBudget *_budget, int _threads) noexcept : budget(_budget), threads(_threads) {}
+		~Lease() noexcept { reset(); }
+
+		Lease(Lease &&other) noexcept : budget(other.budget), threads(other.threads)
+		{
+			other.budget = nullptr;
+			other.threads = 0;
+		}
+
+		Lease &operator=(Lease &&other) noexcept
+		{
+			if (this != &other) {
+				reset();
+				budget = other.budget;
+				threads = other.threads;
+				other.budget = nullptr;
+				other.threads = 0;
+			}
+			return *this;
+		}
+
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		int get() const noexcept { return threads; }
+
+		void reset() noexcept;
+	};
+
+private:
+	mutable std::mutex mtx;
+	Config config;
+	int maxThreads = 1;
+	int leasedThreads = 0;
+	int peakLeasedThreads = 0;
+	std::vector<int> pinnedCpus;
+
+	CpuBudget();
+
+public:
+	static CpuBudget &instance();
+
+	/**
+	 * @brief Reads the budget configuration from a JSON file. Missing keys and a missing file keep the defaults.
+	 * @throws std::runtime_error if the file exists but cannot be parsed.
+	 */
+	static Config loadConfig(const char *path);
+
+	/**
+	 * @brief Applies a configuration. Leases that are already held are kept.
+	 */
+	void configure(const Config &newConfig);
+
+	/**
+	 * @brief Leases up to the given number of threads. At least one thread is always granted so that
+	 * every filter makes progress, even if that exceeds the cap.
+	 */
+	Lease acquire(int requested);
+
+	Lease acquireWorkers() { return acquire(getConfig().workersPerFilter); }
+
+	Lease acquireNcnnThreads() { return acquire(getConfig().ncnnThreadsPerNet); }
+
+	Config getConfig() const;
+
+	/**
+	 * @brief Pins the calling thread and lowers its priority according to the budget.
+	 * Threads spawned afterwards from the calling thread, such as ncnn's OpenMP workers, inherit both on Linux.
+	 */
+	void applyToCurrentThread() const noexcept;
+
+	void logSummary(const BridgeUtils::ILogger &logger) const;
+
+private:
+	void release(int threads) noexcept;
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
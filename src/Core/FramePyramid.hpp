@@ -0,0 +1,189 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+#include <obs.h>
+
+#include "BridgeUtils/AsyncTextureReader.hpp"
+#include "BridgeUtils/GsUnique.hpp"
+
+#include "AnalysisScheduler.hpp"
+#include "MainEffect.hpp"
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief A downsampled BGRX pyramid of the filter source shared by all analyzers.
+ *
+ * Level 0 is 1/2 of the source, level 1 is 1/4 and level 2 is 1/8. Analyzers register the level they need
+ * and whether they need it on the CPU. Only registered levels are allocated. On each analysis frame, every
+ * level needed by the due analyzers is drawn straight from the source in one box-filtered pass, so no finer
+ * level is rendered just to feed a coarser one, and each level is read back at most once no matter how many
+ * analyzers borrow it.
+ *
+ * This class is not thread-safe except for getView(), which follows the AsyncTextureReader rules.
+ */
+class FramePyramid {
+public:
+	static constexpr std::size_t LEVEL_COUNT = 3;
+	static constexpr std::size_t COARSEST_LEVEL = LEVEL_COUNT - 1;
+
+	/**
+	 * @brief A borrowed view into a level read back to the CPU.
+	 */
+	struct View {
+		const std::uint8_t *data;
+		std::uint32_t width;
+		std::uint32_t height;
+		std::uint32_t linesize;
+	};
+
+private:
+	struct Level {
+		std::uint32_t width;
+		std::uint32_t height;
+		BridgeUtils::unique_gs_texture_t texture;
+		std::unique_ptr<BridgeUtils::AsyncTextureReader> reader;
+		AnalysisScheduler::AnalyzerMask gpuUsers = 0;
+		AnalysisScheduler::AnalyzerMask cpuUsers = 0;
+	};
+
+	const std::uint32_t sourceWidth;
+	const std::uint32_t sourceHeight;
+	std::array<Level, LEVEL_COUNT> levels;
+
+public:
+	FramePyramid(std::uint32_t _sourceWidth, std::uint32_t _sourceHeight)
+		: sourceWidth(_sourceWidth),
+		  sourceHeight(_sourceHeight)
+	{
+		for (std::size_t i = 0; i < LEVEL_COUNT; i++) {
+			levels[i].width = std::max<std::uint32_t>(1, sourceWidth >> (i + 1));
+			levels[i].height = std::max<std::uint32_t>(1, sourceHeight >> (i + 1));
+		}
+	}
+
+	/**
+	 * @brief Registers an analyzer as a user of a level.
+	 * @param analyzer The analyzer borrowing the level.
+	 * @param level The pyramid level, from 0 (1/2) to COARSEST_LEVEL (1/8).
+	 * @param readback Whether the analyzer reads the level on the CPU through getView().
+	 */
+	void use(AnalysisScheduler::AnalyzerId analyzer, std::size_t level, bool readback)
+	{
+		Level &l = levels.at(level);
+		if (!l.texture) {
+			l.texture = BridgeUtils::make_unique_gs_texture(l.width, l.height, GS_BGRX, 1, nullptr,
+									GS_RENDER_TARGET);
+		}
+		l.gpuUsers |= AnalysisScheduler::toMask(analyzer);
+
+		if (readback) {
+			if (!l.reader) {
+				l.reader = std::make_unique<BridgeUtils::AsyncTextureReader>(l.width, l.height,
+											     GS_BGRX);
+			}
+			l.cpuUsers |= AnalysisScheduler::toMask(analyzer);
+		}
+	}
+
+	/**
+	 * @brief Returns the coarsest level at least as large as the given size, or level 0 if none is.
+	 */
+	std::size_t findLevel(std::uint32_t minWidth, std::uint32_t minHeight) const noexcept
+	{
+		for (std::size_t i = COARSEST_LEVEL; i > 0; i--) {
+			if (levels[i].width >= minWidth && levels[i].height >= minHeight) {
+				return i;
+			}
+		}
+		return 0;
+	}
+
+	/**
+	 * @brief Renders the levels needed by the given analyzers and stages the ones they read back.
+	 */
+	void render(const MainEffect &mainEffect, obs_source_t *source, AnalysisScheduler::AnalyzerMask analyzers)
+	{
+		for (Level &l : levels) {
+			if (!((l.gpuUsers | l.cpuUsers) & analyzers)) {
+				continue;
+			}
+			mainEffect.drawSourceDownsampled(l.texture, source, sourceWidth, sourceHeight);
+			if (l.cpuUsers & analyzers) {
+				l.reader->stage(l.texture.get());
+			}
+		}
+	}
+
+	/**
+	 * @brief Syncs the CPU copies of the levels read back by the given analyzers.
+	 */
+	void sync(AnalysisScheduler::AnalyzerMask analyzers)
+	{
+		for (Level &l : levels) {
+			if (l.cpuUsers & analyzers) {
+				l.reader->sync();
+			}
+		}
+	}
+
+	BridgeUtils::unique_gs_texture_t &getTexture(std::size_t level) { return levels.at(level).texture; }
+
+	std::uint32_t getWidth(std::size_t level) const { return levels.at(level).width; }
+
+	std::uint32_t getHeight(std::size_t level) const { return levels.at(level).height; }
+
+	/**
+	 * @brief Borrows the latest synced CPU copy of a level.
+	 * @throws std::logic_error if no analyzer requested a readback of the level.
+	 */
+	View getView(std::size_t level)
+	{
+		Level &l = levels.at(level);
+		if (!l.reader) {
+			throw std::logic_error("FramePyramid level was not requested for readback");
+		}
+		return {l.reader->getBuffer().data(), l.width, l.height, l.reader->getBufferLinesize()};
+	}
+
+	/**
+	 * @brief The bytes a sync of the given analyzers' levels copies, for the readback metrics.
+	 */
+	std::size_t getReadbackBytes(AnalysisScheduler::AnalyzerMask analyzers) const noexcept
+	{
+		std::size_t bytes = 0;
+		for (const Level &l : levels) {
+			if (l.cpuUsers & analyzers) {
+				bytes += static_cast<std::size_t>(l.height) * l.reader->getBufferLinesize();
+			}
+		}
+		return bytes;
+	}
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -19,6 +19,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <obs.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
 
 #include "BridgeUtils/GsUnique.hpp"
 
@@ -82,10 +84,14 @@ public:
 	const BridgeUtils::unique_gs_effect_t gsEffect;
 
 	gs_eparam_t *const textureImage;
+	gs_eparam_t *const texturePreviousImage;
+	gs_eparam_t *const sampleStep;
 
 	explicit MainEffect(BridgeUtils::unique_gs_effect_t _gsEffect)
 		: gsEffect(std::move(_gsEffect)),
-		  textureImage(MainEffectDetail::getEffectParam(gsEffect, "image"))
+		  textureImage(MainEffectDetail::getEffectParam(gsEffect, "image")),
+		  texturePreviousImage(MainEffectDetail::getEffectParam(gsEffect, "previousImage")),
+		  sampleStep(MainEffectDetail::getEffectParam(gsEffect, "sampleStep"))
 	{
 	}
 
@@ -105,6 +111,45 @@ public:
 		}
 	}
 
+	void drawSourceRegion(BridgeUtils::unique_gs_texture_t &targetTexture, obs_source_t *source, float x, float y,
+			      float width, float height) const noexcept
+	{
+		TextureRenderGuard renderTargetGuard(targetTexture);
+
+		gs_ortho(x, x + width, y, y + height, -100.0f, 100.0f);
+
+		obs_source_t *target = obs_filter_get_target(source);
+		while (gs_effect_loop(gsEffect.get(), "Draw")) {
+			obs_source_video_render(target);
+		}
+	}
+
+	/**
+	 * @brief Draws the whole source into a smaller target, averaging each target texel from 4x4 bilinear taps.
+	 * At 1/8 the taps fall between source texel pairs, so every source texel is weighted equally. Sources
+	 * that draw themselves with their own effect are point-sampled instead.
+	 */
+	void drawSourceDownsampled(BridgeUtils::unique_gs_texture_t &targetTexture, obs_source_t *source,
+				   std::uint32_t sourceWidth, std::uint32_t sourceHeight) const noexcept
+	{
+		TextureRenderGuard renderTargetGuard(targetTexture);
+
+		gs_ortho(0.0f, static_cast<float>(sourceWidth), 0.0f, static_cast<float>(sourceHeight), -100.0f,
+			 100.0f);
+
+		const float targetWidth = static_cast<float>(gs_texture_get_width(targetTexture.get()));
+		const float targetHeight = static_cast<float>(gs_texture_get_height(targetTexture.get()));
+		// The taps are spaced a quarter of a target texel apart, in source UV units.
+		vec2 step;
+		vec2_set(&step, 0.25f / targetWidth, 0.25f / targetHeight);
+
+		obs_source_t *target = obs_filter_get_target(source);
+		while (gs_effect_loop(gsEffect.get(), "DrawDownsampled")) {
+			gs_effect_set_vec2(sampleStep, &step);
+			obs_source_video_render(target);
+		}
+	}
+
 	void convertToGrayscale(BridgeUtils::unique_gs_texture_t &targetTexture,
 				BridgeUtils::unique_gs_texture_t &sourceTexture, float x = 0.0f, float y = 0.0f,
 				std::uint32_t width = 0, std::uint32_t height = 0)
@@ -132,6 +177,26 @@ public:
 			gs_draw_sprite(sourceTexture.get(), 0, width, height);
 		}
 	}
+
+	void computeTileDifference(BridgeUtils::unique_gs_texture_t &targetTexture,
+				   BridgeUtils::unique_gs_texture_t &currentTexture,
+				   BridgeUtils::unique_gs_texture_t &previousTexture)
+	{
+		TextureRenderGuard renderTargetGuard(targetTexture);
+
+		const std::uint32_t tilesX = gs_texture_get_width(targetTexture.get());
+		const std::uint32_t tilesY = gs_texture_get_height(targetTexture.get());
+
+		vec2 step;
+		vec2_set(&step, 1.0f / static_cast<float>(tilesX * 4), 1.0f / static_cast<float>(tilesY * 4));
+
+		while (gs_effect_loop(gsEffect.get(), "TileDifference")) {
+			gs_effect_set_texture(textureImage, currentTexture.get());
+			gs_effect_set_texture(texturePreviousImage, previousTexture.get());
+			gs_effect_set_vec2(sampleStep, &step);
+			gs_draw_sprite(currentTexture.get(), 0, tilesX, tilesY);
+		}
+	}
 };
 
 } // namespace LiveUniteTools
@@ -18,20 +18,32 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "MainPluginContext.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
 #include <fstream>
 #include <future>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
 
 #include <nlohmann/json.hpp>
 
 #include <obs-module.h>
 #include <obs-frontend-api.h>
+#include <util/platform.h>
 
 #include "BridgeUtils/GsUnique.hpp"
 #include "BridgeUtils/ILogger.hpp"
+#include "BridgeUtils/MemoryAccounting.hpp"
 #include "BridgeUtils/ObsUnique.hpp"
+#include "BridgeUtils/TraceRecorder.hpp"
 
 #include "Core/MainEffect.hpp"
+#include "Core/PluginMetrics.hpp"
+#include "SharedMemory/SharedResultChannel.hpp"
 
 using namespace KaitoTokyo::BridgeUtils;
 using json = nlohmann::json;
@@ -39,14 +51,100 @@ using json = nlohmann::json;
 namespace KaitoTokyo {
 namespace LiveUniteTools {
 
+namespace {
+
+bool dumpTraceClicked(obs_properties_t *, obs_property_t *, void *data)
+{
+	static_cast<MainPluginContext *>(data)->dumpTrace();
+	return false;
+}
+
+/**
+ * @brief Stops pooling released GPU objects while the plugin is over its soft memory budget.
+ * The pool is shared by all filter instances, so only the instance that sees a transition acts on it.
+ */
+void enforceMemoryBudget(const ILogger &logger)
+{
+	static std::atomic<bool> overBudget = false;
+
+	MemoryAccounting &accounting = MemoryAccounting::instance();
+	const bool isOver = accounting.isOverSoftBudget();
+	if (overBudget.exchange(isOver) == isOver) {
+		return;
+	}
+
+	if (isOver) {
+		logger.warn("Memory usage {} KiB exceeds the soft budget of {} KiB, disabling the GPU pool",
+			    accounting.getTotalBytes() / 1024, accounting.getSoftBudgetBytes() / 1024);
+		GsUnique::setPoolCapacityBytes(0);
+	} else {
+		logger.info("Memory usage is back under the soft budget, enabling the GPU pool");
+		GsUnique::setPoolCapacityBytes(GsUnique::DEFAULT_POOL_CAPACITY_BYTES);
+	}
+}
+
+/**
+ * @brief Trades analysis quality for memory and work while the plugin is over its soft memory budget.
+ */
+PluginConfig degradeForMemoryBudget(PluginConfig pluginConfig) noexcept
+{
+	// Fewer results in flight mean fewer readback buffers and ncnn blobs alive at once.
+	pluginConfig.contextClassifierRateHz /= 2.0;
+	pluginConfig.matchTimerRateHz /= 2.0;
+	pluginConfig.requireFullResolutionSource = false;
+	return pluginConfig;
+}
+
+/**
+ * @brief Records whether one filter wants tracing. The recorder is process-wide, so it stays on while any
+ * filter wants it.
+ */
+void setTraceRequested(bool &requested, bool value) noexcept
+{
+	static std::mutex mtx;
+	static int requestCount = 0;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	if (requested == value) {
+		return;
+	}
+	requested = value;
+	requestCount += value ? 1 : -1;
+	TraceRecorder::instance().setEnabled(requestCount > 0);
+}
+
+/**
+ * @brief Counts the shared-memory channel as an in-process consumer of the results it publishes, so that their
+ * analyzers keep running without WebSocket clients. Scores come from the classifier's analyzer anyway.
+ */
+void setSharedMemoryConsumers(bool value) noexcept
+{
+	const std::shared_ptr<WebSocketServer> webSocketServer = WebSocketServer::getSharedWebSocketServer();
+	for (const WebSocketServer::Topic topic : {WebSocketServer::Topic::Classifier, WebSocketServer::Topic::Timer}) {
+		if (value) {
+			webSocketServer->addInternalConsumer(topic);
+		} else {
+			webSocketServer->removeInternalConsumer(topic);
+		}
+	}
+}
+
+} // namespace
+
 MainPluginContext::MainPluginContext(obs_data_t *settings, obs_source_t *_source,
 				     std::shared_future<std::string> _latestVersionFuture,
 				     const BridgeUtils::ILogger &_logger)
 	: source{_source},
 	  logger(_logger),
 	  latestVersionFuture{_latestVersionFuture},
-	  mainTaskQueue(logger, 1)
+	  workerLease(CpuBudget::instance().acquireWorkers()),
+	  mainTaskQueue(logger, 4, workerLease.get(),
+			[] {
+				TraceRecorder::setThreadName("analysis worker");
+				CpuBudget::instance().applyToCurrentThread();
+			})
 {
+	PluginMetrics::instance().registerTaskQueue(mainTaskQueue);
 	update(settings);
 }
 
@@ -57,7 +155,15 @@ void MainPluginContext::shutdown() noexcept
 	mainTaskQueue.shutdown();
 }
 
-MainPluginContext::~MainPluginContext() noexcept {}
+MainPluginContext::~MainPluginContext() noexcept
+{
+	setTraceRequested(traceRequested, false);
+	if (sharedMemoryAcquired) {
+		setSharedMemoryConsumers(false);
+		SharedResultChannel::instance().release();
+	}
+	PluginMetrics::instance().unregisterTaskQueue(mainTaskQueue);
+}
 
 std::uint32_t MainPluginContext::getWidth() const noexcept
 {
@@ -69,7 +175,12 @@ std::uint32_t MainPluginContext::getHeight() const noexcept
 	return renderingContext ? renderingContext->height : 0;
 }
 
-void MainPluginContext::getDefaults(obs_data_t *) {}
+void MainPluginContext::getDefaults(obs_data_t *data)
+{
+	obs_data_set_default_int(data, "captureFps", DEFAULT_CAPTURE_FPS);
+	obs_data_set_default_bool(data, "traceEnabled", false);
+	obs_data_set_default_bool(data, "sharedMemoryEnabled", false);
+}
 
 obs_properties_t *MainPluginContext::getProperties()
 {
@@ -81,10 +192,68 @@ obs_properties_t *MainPluginContext::getProperties()
 	obs_property_list_add_int(captureFpsProp, "60", 60);
 	obs_property_list_add_int(captureFpsProp, "120", 120);
 
+	obs_properties_add_bool(props, "sharedMemoryEnabled", obs_module_text("sharedMemoryEnabled"));
+	obs_properties_add_bool(props, "traceEnabled", obs_module_text("traceEnabled"));
+	obs_properties_add_button2(props, "dumpTrace", obs_module_text("dumpTrace"), dumpTraceClicked, this);
+
 	return props;
 }
 
-void MainPluginContext::update(obs_data_t *) {}
+void MainPluginContext::update(obs_data_t *settings)
+{
+	captureFps = static_cast<int>(obs_data_get_int(settings, "captureFps"));
+	setTraceRequested(traceRequested, obs_data_get_bool(settings, "traceEnabled"));
+
+	const bool sharedMemoryRequested = obs_data_get_bool(settings, "sharedMemoryEnabled");
+	if (sharedMemoryRequested && !sharedMemoryAcquired) {
+		sharedMemoryAcquired = SharedResultChannel::instance().acquire();
+		if (sharedMemoryAcquired) {
+			setSharedMemoryConsumers(true);
+		} else {
+			logger.error("Failed to set up the shared-memory result channel");
+		}
+	} else if (!sharedMemoryRequested && sharedMemoryAcquired) {
+		setSharedMemoryConsumers(false);
+		SharedResultChannel::instance().release();
+		sharedMemoryAcquired = false;
+	}
+}
+
+void MainPluginContext::loadMemoryBudget(const char *path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		return;
+	}
+
+	const json j = json::parse(file, nullptr, false);
+	if (j.is_discarded() || !j.is_object()) {
+		throw std::runtime_error("Failed to parse memory budget configuration");
+	}
+
+	const std::int64_t softBudgetMiB = std::max<std::int64_t>(0, j.value("softBudgetMiB", std::int64_t{0}));
+	MemoryAccounting::instance().setSoftBudgetBytes(softBudgetMiB * 1024 * 1024);
+}
+
+void MainPluginContext::dumpTrace()
+{
+	unique_bfree_char_t traceDir(obs_module_config_path("traces"));
+	if (!traceDir || os_mkdirs(traceDir.get()) == MKDIR_ERROR) {
+		logger.error("Failed to create the trace directory");
+		return;
+	}
+
+	char timestamp[32];
+	const std::time_t now = std::time(nullptr);
+	std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+	const std::string path = std::string(traceDir.get()) + "/trace-" + timestamp + ".json";
+
+	if (TraceRecorder::instance().dump(path.c_str())) {
+		logger.info("Trace written to {}", path);
+	} else {
+		logger.error("Failed to write trace to {}", path);
+	}
+}
 
 void MainPluginContext::activate() {}
 
@@ -106,16 +275,25 @@ void MainPluginContext::videoTick(float seconds)
 	}
 
 	if (targetWidth > 0 || targetHeight > 0) {
+		// A context is degraded once when the plugin goes over its soft memory budget. It is only restored
+		// when it is rebuilt for another reason, so that freeing memory does not make it flip back and forth.
 		if (!renderingContext || renderingContext->width != targetWidth ||
-		    renderingContext->height != targetHeight) {
+		    renderingContext->height != targetHeight ||
+		    (!renderingContextDegraded && MemoryAccounting::instance().isOverSoftBudget())) {
 			GraphicsContextGuard guard;
+			// Release the old context first so that its textures and stagesurfs are reused.
+			renderingContext.reset();
 			renderingContext = makeRenderingContext(targetWidth, targetHeight);
 			GsUnique::drain();
 		}
 
+		enforceMemoryBudget(logger);
+
+		renderingContext->setCaptureFps(captureFps);
 		renderingContext->videoTick(seconds);
 	} else {
-		logger.debug("Target width or height is zero, skipping video tick");
+		static LogSite site;
+		logger.debug(site, "Target width or height is zero, skipping video tick");
 		renderingContext.reset();
 	}
 }
@@ -125,7 +303,8 @@ void MainPluginContext::videoRender()
 	if (renderingContext) {
 		renderingContext->videoRender();
 	} else {
-		logger.debug("Rendering context is not initialized, skipping video render");
+		static LogSite site;
+		logger.debug(site, "Rendering context is not initialized, skipping video render");
 		obs_source_skip_video_filter(source);
 	}
 }
@@ -135,14 +314,17 @@ try {
 	if (renderingContext) {
 		return renderingContext->filterVideo(frame);
 	} else {
-		logger.debug("Rendering context is not initialized, skipping video filter");
+		static LogSite site;
+		logger.debug(site, "Rendering context is not initialized, skipping video filter");
 		return frame;
 	}
 } catch (const std::exception &e) {
-	logger.error("Failed to create rendering context: {}", e.what());
+	static LogSite site;
+	logger.error(site, "Failed to create rendering context: {}", e.what());
 	return frame;
 } catch (...) {
-	logger.error("Failed to create rendering context: unknown error");
+	static LogSite site;
+	logger.error(site, "Failed to create rendering context: unknown error");
 	return frame;
 }
 
@@ -154,10 +336,23 @@ std::shared_ptr<RenderingContext> MainPluginContext::makeRenderingContext(std::u
 
 	std::shared_ptr<WebSocketServer> webSocketServer = WebSocketServer::getSharedWebSocketServer();
 
-	PluginConfig defaultConfig;
+	PluginConfig pluginConfig;
+	renderingContextDegraded = MemoryAccounting::instance().isOverSoftBudget();
+	if (renderingContextDegraded) {
+		pluginConfig = degradeForMemoryBudget(pluginConfig);
+		logger.warn("Over the soft memory budget, degrading analysis: classifier at {} Hz, "
+			    "match timer at {} Hz, no full-resolution source",
+			    pluginConfig.contextClassifierRateHz, pluginConfig.matchTimerRateHz);
+	}
+
+	const std::int64_t totalBytesBefore = MemoryAccounting::instance().getTotalBytes();
+	auto newRenderingContext = std::make_shared<RenderingContext>(
+		source, logger, std::move(gsMainEffect), std::move(webSocketServer), mainTaskQueue,
+		std::move(pluginConfig), targetWidth, targetHeight, captureFps);
+	logger.info("Rendering context {}x{} allocated {} KiB", targetWidth, targetHeight,
+		    (MemoryAccounting::instance().getTotalBytes() - totalBytesBefore) / 1024);
 
-	return std::make_shared<RenderingContext>(source, logger, std::move(gsMainEffect), std::move(webSocketServer),
-						  mainTaskQueue, std::move(defaultConfig), targetWidth, targetHeight);
+	return newRenderingContext;
 }
 
 } // namespace LiveUniteTools
@@ -24,11 +24,13 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <future>
 
 #include "BridgeUtils/ILogger.hpp"
 #include "BridgeUtils/ThrottledTaskQueue.hpp"
 
+#include "CpuBudget.hpp"
 #include "PluginConfig.hpp"
 #include "RenderingContext.hpp"
 
@@ -36,13 +38,25 @@ namespace KaitoTokyo {
 namespace LiveUniteTools {
 
 class MainPluginContext : public std::enable_shared_from_this<MainPluginContext> {
+public:
+	static constexpr int DEFAULT_CAPTURE_FPS = 30;
+
 private:
 	obs_source_t *const source;
 	const BridgeUtils::ILogger &logger;
 	std::shared_future<std::string> latestVersionFuture;
+	CpuBudget::Lease workerLease;
 	BridgeUtils::ThrottledTaskQueue mainTaskQueue;
 
+	std::atomic<int> captureFps = DEFAULT_CAPTURE_FPS;
+	/** Whether this filter asks for tracing, which is on while any filter does. */
+	bool traceRequested = false;
+	/** Whether this filter holds the shared-memory result channel, which exists while any filter does. */
+	bool sharedMemoryAcquired = false;
+
 	std::shared_ptr<RenderingContext> renderingContext;
+	/** Whether renderingContext was built degraded because of the soft memory budget. */
+	bool renderingContextDegraded = false;
 
 public:
 	MainPluginContext(obs_data_t *settings, obs_source_t *source,
@@ -56,6 +70,11 @@ public:
 
 	static void getDefaults(obs_data_t *data);
 
+	/**
+	 * @brief Reads the plugin-wide soft memory budget ({"softBudgetMiB": N}). A missing file means no budget.
+	 */
+	static void loadMemoryBudget(const char *path);
+
 	obs_properties_t *getProperties();
 	void update(obs_data_t *settings);
 	void activate();
@@ -63,6 +82,8 @@ public:
 	void show();
 	void hide();
 
+	void dumpTrace();
+
 	void videoTick(float seconds);
 	void videoRender();
 	obs_source_frame *filterVideo(obs_source_frame *frame);
@@ -24,10 +24,16 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 
+#include "BridgeUtils/AsyncObsLogger.hpp"
 #include "BridgeUtils/GsUnique.hpp"
-#include "BridgeUtils/ObsLogger.hpp"
+#include "BridgeUtils/MemoryAccounting.hpp"
+#include "BridgeUtils/ObsUnique.hpp"
+
+#include "CpuBudget.hpp"
+#include "PluginMetrics.hpp"
 
 #include "../UpdateChecker/UpdateChecker.hpp"
+#include "../WebSocketServer/WebSocketServer.hpp"
 
 using namespace KaitoTokyo::BridgeUtils;
 using namespace KaitoTokyo::LiveUniteTools;
@@ -36,22 +42,74 @@ namespace {
 
 std::shared_future<std::string> latestVersionFuture;
 
-inline const ILogger &logger()
+inline AsyncObsLogger &asyncLogger()
 {
-	static const ObsLogger instance("[" PLUGIN_NAME "] ");
+	static AsyncObsLogger instance("[" PLUGIN_NAME "] ");
 	return instance;
 }
 
+inline const ILogger &logger()
+{
+	return asyncLogger();
+}
+
 } // namespace
 
 bool main_plugin_context_module_load()
 try {
+#ifdef NDEBUG
+	asyncLogger().setMinLevel(ILogger::LogLevel::Info);
+#endif
+
 	curl_global_init(CURL_GLOBAL_DEFAULT);
 	latestVersionFuture =
 		std::async(std::launch::async, [] {
 			return KaitoTokyo::UpdateChecker::fetchLatestVersion(
 				"https://kaito-tokyo.github.io/live-unite-tools/metadata/latest-version.txt");
 		}).share();
+
+	try {
+		unique_bfree_char_t configPath(obs_module_config_path("cpu-budget.json"));
+		if (configPath) {
+			CpuBudget::instance().configure(CpuBudget::loadConfig(configPath.get()));
+		}
+	} catch (const std::exception &e) {
+		logger().error("Failed to load CPU budget, using defaults: {}", e.what());
+	}
+	CpuBudget::instance().logSummary(logger());
+
+	try {
+		unique_bfree_char_t configPath(obs_module_config_path("memory-budget.json"));
+		if (configPath) {
+			MainPluginContext::loadMemoryBudget(configPath.get());
+		}
+	} catch (const std::exception &e) {
+		logger().error("Failed to load memory budget, running without one: {}", e.what());
+	}
+
+	WebSocketServer::Config webSocketConfig;
+	try {
+		unique_bfree_char_t configPath(obs_module_config_path("websocket.json"));
+		if (configPath) {
+			webSocketConfig = WebSocketServer::loadConfig(configPath.get());
+		}
+	} catch (const std::exception &e) {
+		logger().error("Failed to load WebSocket server configuration, using defaults: {}", e.what());
+	}
+	try {
+		unique_bfree_char_t browserPath(unique_obs_module_file("browser"));
+		if (browserPath) {
+			auto assets = std::make_shared<const StaticAssets>(StaticAssets::load(browserPath.get()));
+			logger().info("Serving {} overlay assets ({} KiB in memory)", assets->getAssetCount(),
+				      assets->getTotalBytes() / 1024);
+			webSocketConfig.assets = std::move(assets);
+		}
+	} catch (const std::exception &e) {
+		logger().error("Failed to load overlay assets, not serving them over HTTP: {}", e.what());
+	}
+	webSocketConfig.metricsWriter = [](PrometheusText &text) { PluginMetrics::instance().write(text); };
+	WebSocketServer::configure(webSocketConfig);
+
 	logger().info("plugin loaded successfully (version " PLUGIN_VERSION ")");
 	return true;
 } catch (const std::exception &e) {
@@ -65,12 +123,17 @@ try {
 void main_plugin_context_module_unload()
 try {
 	GraphicsContextGuard guard;
+	GsUnique::clearPools();
 	GsUnique::drain();
+	MemoryAccounting::instance().logSummary(logger());
 	logger().info("plugin unloaded");
+	asyncLogger().shutdown();
 } catch (const std::exception &e) {
 	logger().error("Failed to unload main plugin context: %s", e.what());
+	asyncLogger().shutdown();
 } catch (...) {
 	logger().error("Failed to unload main plugin context: unknown error");
+	asyncLogger().shutdown();
 }
 
 const char *main_plugin_context_get_name(void *type_data)
@@ -240,16 +303,19 @@ try {
 void main_plugin_context_video_tick(void *data, float seconds)
 try {
 	if (!data) {
-		logger().error("main_plugin_context_video_tick called with null data");
+		static LogSite site;
+		logger().error(site, "main_plugin_context_video_tick called with null data");
 		return;
 	}
 
 	auto self = static_cast<std::shared_ptr<MainPluginContext> *>(data);
 	self->get()->videoTick(seconds);
 } catch (const std::exception &e) {
-	logger().error("Failed to tick main plugin context: %s", e.what());
+	static LogSite site;
+	logger().error(site, "Failed to tick main plugin context: {}", e.what());
 } catch (...) {
-	logger().error("Failed to tick main plugin context: unknown error");
+	static LogSite site;
+	logger().error(site, "Failed to tick main plugin context: unknown error");
 }
 
 void main_plugin_context_video_render(void *data, gs_effect_t *_unused)
@@ -257,7 +323,8 @@ try {
 	UNUSED_PARAMETER(_unused);
 
 	if (!data) {
-		logger().error("main_plugin_context_video_render called with null data");
+		static LogSite site;
+		logger().error(site, "main_plugin_context_video_render called with null data");
 		return;
 	}
 
@@ -265,15 +332,18 @@ try {
 	self->get()->videoRender();
 	GsUnique::drain();
 } catch (const std::exception &e) {
-	logger().error("Failed to render video in main plugin context: %s", e.what());
+	static LogSite site;
+	logger().error(site, "Failed to render video in main plugin context: {}", e.what());
 } catch (...) {
-	logger().error("Failed to render video in main plugin context: unknown error");
+	static LogSite site;
+	logger().error(site, "Failed to render video in main plugin context: unknown error");
 }
 
 struct obs_source_frame *main_plugin_context_filter_video(void *data, struct obs_source_frame *frame)
 try {
 	if (!data) {
-		logger().error("main_plugin_context_filter_video called with null data");
+		static LogSite site;
+		logger().error(site, "main_plugin_context_filter_video called with null data");
 		return frame;
 	}
 
@@ -281,9 +351,11 @@ try {
 	obs_source_frame *result = self->get()->filterVideo(frame);
 	return result;
 } catch (const std::exception &e) {
-	logger().error("Failed to filter video in main plugin context: %s", e.what());
+	static LogSite site;
+	logger().error(site, "Failed to filter video in main plugin context: {}", e.what());
 	return frame;
 } catch (...) {
-	logger().error("Failed to filter video in main plugin context: unknown error");
+	static LogSite site;
+	logger().error(site, "Failed to filter video in main plugin context: unknown error");
 	return frame;
 }
@@ -30,6 +30,16 @@ struct PluginConfigRegion {
 
 struct PluginConfig {
 	PluginConfigRegion matchTimerRegion = {900.0 / 1920.0, 10.0 / 1080.0, 110.0 / 1920.0, 60.0 / 1080.0};
+	bool requireFullResolutionSource = false;
+	double contextClassifierRateHz = 5.0;
+	double matchTimerRateHz = 2.0;
+	double changeDetectionThreshold = 0.02;
+	/** A digit change covers only a few percent of a tile, so the timer region reacts to much less. */
+	double matchTimerChangeThreshold = 0.004;
+	double maxChangeSkipSeconds = 1.0;
+	int staleFrameLimit = 3;
+	double classSwitchMargin = 0.1;
+	int classSwitchConfirmations = 2;
 };
 
 } // namespace LiveUniteTools
@@ -0,0 +1,109 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PluginMetrics.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "BridgeUtils/MemoryAccounting.hpp"
+
+using namespace KaitoTokyo::BridgeUtils;
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+void PluginMetrics::registerTaskQueue(ThrottledTaskQueue &taskQueue)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	taskQueues.push_back(&taskQueue);
+}
+
+void PluginMetrics::unregisterTaskQueue(ThrottledTaskQueue &taskQueue) noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	taskQueues.erase(std::remove(taskQueues.begin(), taskQueues.end(), &taskQueue), taskQueues.end());
+}
+
+void PluginMetrics::write(PrometheusText &text)
+{
+	text.family("live_unite_frames_analyzed_total", "counter", "Frames staged for at least one analyzer.");
+	text.sample("live_unite_frames_analyzed_total", {}, framesAnalyzed.load(std::memory_order_relaxed));
+	text.family("live_unite_frames_skipped_total", "counter",
+		    "Frames whose due analyzers were skipped because their regions were unchanged.");
+	text.sample("live_unite_frames_skipped_total", {}, framesSkipped.load(std::memory_order_relaxed));
+	text.family("live_unite_readback_bytes_total", "counter", "Bytes read back from the GPU for analysis.");
+	text.sample("live_unite_readback_bytes_total", {}, readbackBytes.load(std::memory_order_relaxed));
+
+	text.histogram("live_unite_inference_seconds", "Context classifier inference time.", inferenceNs);
+	text.histogram("live_unite_ocr_seconds", "Match timer OCR time.", ocrNs);
+
+	// Filter instances share task keys, so their counters are summed per key.
+	struct TaskCounts {
+		std::uint64_t expired = 0;
+		std::uint64_t replaced = 0;
+		std::uint64_t evicted = 0;
+		std::uint64_t cancelled = 0;
+	};
+	std::map<std::string_view, TaskCounts> taskCounts;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (ThrottledTaskQueue *taskQueue : taskQueues) {
+			for (const ThrottledTaskQueue::TaskStatsSnapshot &stats : taskQueue->snapshot()) {
+				TaskCounts &counts = taskCounts[stats.key.empty() ? "unkeyed" : stats.key];
+				counts.expired += stats.expiredCount;
+				counts.replaced += stats.replacedCount;
+				counts.evicted += stats.evictedCount;
+				counts.cancelled += stats.cancelledCount;
+			}
+		}
+	}
+
+	text.family("live_unite_task_dropped_total", "counter", "Analysis tasks dropped before running, by reason.");
+	for (const auto &[key, counts] : taskCounts) {
+		const std::string task = "task=\"" + std::string(key) + "\"";
+		text.sample("live_unite_task_dropped_total", task + ",reason=\"expired\"", counts.expired);
+		text.sample("live_unite_task_dropped_total", task + ",reason=\"replaced\"", counts.replaced);
+		text.sample("live_unite_task_dropped_total", task + ",reason=\"evicted\"", counts.evicted);
+	}
+	text.family("live_unite_task_cancelled_total", "counter", "Analysis tasks cancelled before they ran.");
+	for (const auto &[key, counts] : taskCounts) {
+		text.sample("live_unite_task_cancelled_total", "task=\"" + std::string(key) + "\"", counts.cancelled);
+	}
+
+	const MemoryAccounting &memoryAccounting = MemoryAccounting::instance();
+	text.family("live_unite_memory_bytes", "gauge", "Memory held by the plugin, by category.");
+	for (std::size_t i = 0; i < MemoryAccounting::CATEGORY_COUNT; i++) {
+		const auto category = static_cast<MemoryAccounting::Category>(i);
+		text.sample("live_unite_memory_bytes",
+			    std::string("category=\"") + MemoryAccounting::getCategoryName(category) + "\"",
+			    memoryAccounting.getCurrentBytes(category));
+	}
+	text.family("live_unite_memory_peak_bytes", "gauge", "High-water mark of the memory held, by category.");
+	for (std::size_t i = 0; i < MemoryAccounting::CATEGORY_COUNT; i++) {
+		const auto category = static_cast<MemoryAccounting::Category>(i);
+		text.sample("live_unite_memory_peak_bytes",
+			    std::string("category=\"") + MemoryAccounting::getCategoryName(category) + "\"",
+			    memoryAccounting.getPeakBytes(category));
+	}
+}
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -0,0 +1,96 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "BridgeUtils/LatencyHistogram.hpp"
+#include "BridgeUtils/PrometheusText.hpp"
+#include "BridgeUtils/ThrottledTaskQueue.hpp"
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief The process-wide analysis counters of all filter instances, exported at the /metrics endpoint.
+ *
+ * Counters and histograms are updated with relaxed atomics from the render and worker threads, and are
+ * only formatted when scraped. Task queues are registered so that their drop and cancellation counters can
+ * be read on scrape; the registry lock is never taken on the update paths.
+ */
+class PluginMetrics {
+private:
+	std::atomic<std::uint64_t> framesAnalyzed = 0;
+	std::atomic<std::uint64_t> framesSkipped = 0;
+	std::atomic<std::uint64_t> readbackBytes = 0;
+	BridgeUtils::LatencyHistogram inferenceNs;
+	BridgeUtils::LatencyHistogram ocrNs;
+
+	std::mutex mtx;
+	std::vector<BridgeUtils::ThrottledTaskQueue *> taskQueues;
+
+	PluginMetrics() = default;
+
+public:
+	static PluginMetrics &instance()
+	{
+		static PluginMetrics metrics;
+		return metrics;
+	}
+
+	PluginMetrics(const PluginMetrics &) = delete;
+	PluginMetrics &operator=(const PluginMetrics &) = delete;
+
+	/**
+	 * @brief Counts a frame that was staged for at least one analyzer.
+	 */
+	void addFrameAnalyzed() noexcept { framesAnalyzed.fetch_add(1, std::memory_order_relaxed); }
+
+	/**
+	 * @brief Counts a frame whose due analyzers were all skipped because their regions were unchanged.
+	 */
+	void addFrameSkipped() noexcept { framesSkipped.fetch_add(1, std::memory_order_relaxed); }
+
+	void addReadbackBytes(std::uint64_t bytes) noexcept
+	{
+		readbackBytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	void recordInference(std::uint64_t durationNs) noexcept { inferenceNs.record(durationNs); }
+
+	void recordOcr(std::uint64_t durationNs) noexcept { ocrNs.record(durationNs); }
+
+	/**
+	 * @brief Includes a task queue in the scrape until it is unregistered. The queue must outlive that.
+	 */
+	void registerTaskQueue(BridgeUtils::ThrottledTaskQueue &taskQueue);
+
+	void unregisterTaskQueue(BridgeUtils::ThrottledTaskQueue &taskQueue) noexcept;
+
+	/**
+	 * @brief Writes every metric, including the memory accounting, in the Prometheus text format.
+	 */
+	void write(BridgeUtils::PrometheusText &text);
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -20,12 +20,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <cmath>
 
+#include <nlohmann/json.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "BridgeUtils/MemoryAccounting.hpp"
+#include "BridgeUtils/TraceRecorder.hpp"
+
+#include "../Core/PluginMetrics.hpp"
+#include "../SharedMemory/SharedResultChannel.hpp"
 #include "../WebSocketServer/WebSocketServer.hpp"
-#include "../TesseractReader/MatchTimerReader.hpp"
 
 using namespace KaitoTokyo::BridgeUtils;
+using json = nlohmann::json;
 
 namespace KaitoTokyo {
 namespace LiveUniteTools {
@@ -33,10 +39,61 @@ namespace LiveUniteTools {
 constexpr std::uint32_t EFFICIENTNET_INPUT_WIDTH = 224;
 constexpr std::uint32_t EFFICIENTNET_INPUT_HEIGHT = 224;
 
+constexpr std::chrono::seconds STATS_REPORT_INTERVAL(60);
+constexpr std::chrono::seconds STATS_PUBLISH_INTERVAL(1);
+
+namespace {
+
+enum GpuPass : std::size_t {
+	GPU_PASS_DRAW_SOURCE,
+	GPU_PASS_FRAME_PYRAMID,
+	GPU_PASS_TILE_DIFFERENCE,
+	GPU_PASS_STAGE_CHANGE_MAP,
+	GPU_PASS_DRAW_MATCH_TIMER,
+	GPU_PASS_CONVERT_MATCH_TIMER_TO_HSV,
+	GPU_PASS_STAGE_MATCH_TIMER,
+};
+
+std::vector<const char *> getGpuPassNames()
+{
+	return {
+		"drawSource",
+		"framePyramid",
+		"tileDifference",
+		"stageChangeMap",
+		"drawMatchTimer",
+		"convertMatchTimerToHSV",
+		"stageMatchTimer",
+	};
+}
+
+void syncReader(AsyncTextureReader &reader)
+{
+	reader.sync();
+	PluginMetrics::instance().addReadbackBytes(reader.getBuffer().size());
+}
+
+std::uint64_t getElapsedNs(std::chrono::steady_clock::time_point start) noexcept
+{
+	return static_cast<std::uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+			.count());
+}
+
+/**
+ * @brief Converts a fraction of full scale into the 8-bit units of the change map.
+ */
+std::uint8_t toChangeThreshold(double fraction) noexcept
+{
+	return static_cast<std::uint8_t>(std::clamp(std::lround(fraction * 255.0), 0L, 255L));
+}
+
+} // namespace
+
 RenderingContext::RenderingContext(obs_source_t *_source, const ILogger &_logger, unique_gs_effect_t gsMainEffect,
 				   std::shared_ptr<WebSocketServer> _webSocketServer,
 				   ThrottledTaskQueue &_mainTaskQueue, PluginConfig _pluginConfig, std::uint32_t _width,
-				   std::uint32_t _height)
+				   std::uint32_t _height, int captureFps)
 	: source(_source),
 	  logger(_logger),
 	  mainEffect(std::move(gsMainEffect)),
@@ -45,7 +102,9 @@ RenderingContext::RenderingContext(obs_source_t *_source, const ILogger &_logger
 	  width(_width),
 	  height(_height),
 	  pluginConfig(_pluginConfig),
-	  bgrxSourceImage(make_unique_gs_texture(width, height, GS_BGRX, 1, nullptr, GS_RENDER_TARGET)),
+	  bgrxSourceImage(pluginConfig.requireFullResolutionSource
+				  ? make_unique_gs_texture(width, height, GS_BGRX, 1, nullptr, GS_RENDER_TARGET)
+				  : nullptr),
 	  efficientNetRoiPosition{[this]() -> RoiPosition {
 		  double widthScale = static_cast<double>(EFFICIENTNET_INPUT_WIDTH) / static_cast<double>(width);
 		  double heightScale = static_cast<double>(EFFICIENTNET_INPUT_HEIGHT) / static_cast<double>(height);
@@ -61,19 +120,50 @@ RenderingContext::RenderingContext(obs_source_t *_source, const ILogger &_logger
 		  pos.bottom = EFFICIENTNET_INPUT_HEIGHT - pos.top;
 		  return pos;
 	  }()},
-	  bgrxSceneDetectorInput(make_unique_gs_texture(224, 224, GS_BGRX, 1, nullptr, GS_RENDER_TARGET)),
-	  bgrxSceneDetectorInputReader(224, 224, GS_BGRX),
 	  matchTimerRegion{static_cast<std::uint32_t>(pluginConfig.matchTimerRegion.x * width),
 			   static_cast<std::uint32_t>(pluginConfig.matchTimerRegion.y * height),
 			   static_cast<std::uint32_t>(pluginConfig.matchTimerRegion.width * width) & ~1u,
 			   static_cast<std::uint32_t>(pluginConfig.matchTimerRegion.height * height) & ~1u},
+	  bgrxMatchTimer(make_unique_gs_texture(matchTimerRegion.width, matchTimerRegion.height, GS_BGRX, 1, nullptr,
+						GS_RENDER_TARGET)),
 	  hsvxMatchTimer(make_unique_gs_texture(matchTimerRegion.width, matchTimerRegion.height, GS_BGRX, 1, nullptr,
 						GS_RENDER_TARGET)),
 	  hsvxMatchTimerReader(matchTimerRegion.width, matchTimerRegion.height, GS_BGRX),
-	  contextClassifier(contextClassifierNet)
+	  framePyramid(width, height),
+	  contextClassifierLevel(framePyramid.findLevel(efficientNetRoiPosition.right - efficientNetRoiPosition.left,
+							efficientNetRoiPosition.bottom - efficientNetRoiPosition.top)),
+	  bgrxChangeDetectorPreviousFrame(make_unique_gs_texture(framePyramid.getWidth(FramePyramid::COARSEST_LEVEL),
+								 framePyramid.getHeight(FramePyramid::COARSEST_LEVEL),
+								 GS_BGRX, 1, nullptr, GS_RENDER_TARGET)),
+	  r8ChangeMap(make_unique_gs_texture(ChangeMap::TILES_X, ChangeMap::TILES_Y, GS_R8, 1, nullptr,
+					     GS_RENDER_TARGET)),
+	  r8ChangeMapReader(ChangeMap::TILES_X, ChangeMap::TILES_Y, GS_R8),
+	  analysisScheduler(captureFps),
+	  changeDetectorAnalyzer(analysisScheduler.addAnalyzer(0.0, false)),
+	  contextClassifierAnalyzer(analysisScheduler.addAnalyzer(pluginConfig.contextClassifierRateHz, true)),
+	  matchTimerAnalyzer(analysisScheduler.addAnalyzer(pluginConfig.matchTimerRateHz, true)),
+	  changeMap(width, height,
+		    std::chrono::duration_cast<ChangeMap::Clock::duration>(
+			    std::chrono::duration<double>(pluginConfig.maxChangeSkipSeconds))),
+	  ncnnThreadLease(CpuBudget::instance().acquireNcnnThreads()),
+	  contextClassifier(contextClassifierNet),
+	  classDebouncer(static_cast<float>(pluginConfig.classSwitchMargin), pluginConfig.classSwitchConfirmations),
+	  gpuPassProfiler(getGpuPassNames()),
+	  lastStatsReportTime(std::chrono::steady_clock::now()),
+	  lastStatsPublishTime(lastStatsReportTime)
 {
-	contextClassifierNet.opt.num_threads = 2;
+	framePyramid.use(changeDetectorAnalyzer, FramePyramid::COARSEST_LEVEL, false);
+	framePyramid.use(contextClassifierAnalyzer, contextClassifierLevel, true);
+
+	changeMap.watch(contextClassifierAnalyzer, 0, 0, width, height,
+			toChangeThreshold(pluginConfig.changeDetectionThreshold));
+	changeMap.watch(matchTimerAnalyzer, matchTimerRegion.x, matchTimerRegion.y, matchTimerRegion.width,
+			matchTimerRegion.height, toChangeThreshold(pluginConfig.matchTimerChangeThreshold));
+
+	contextClassifierNet.opt.num_threads = ncnnThreadLease.get();
 	contextClassifierNet.opt.use_local_pool_allocator = true;
+	contextClassifierNet.opt.blob_allocator = &ncnnBlobAllocator;
+	contextClassifierNet.opt.workspace_allocator = &ncnnWorkspaceAllocator;
 	contextClassifierNet.opt.openmp_blocktime = 1;
 
 	unique_bfree_char_t paramPath = unique_obs_module_file("models/ContextClassifier.ncnn.param");
@@ -93,45 +183,269 @@ RenderingContext::RenderingContext(obs_source_t *_source, const ILogger &_logger
 	}
 }
 
-RenderingContext::~RenderingContext() noexcept {}
+RenderingContext::~RenderingContext() noexcept
+{
+	gpuPassProfiler.logSummary(logger);
+}
 
-void RenderingContext::videoTick(float)
+void RenderingContext::setCaptureFps(int captureFps)
 {
-	doesNextVideoRenderReceiveNewFrame = true;
+	analysisScheduler.setCaptureFps(captureFps);
+}
 
-	mainTaskQueue.push([self = shared_from_this()](const ThrottledTaskQueue::CancellationToken &token) {
-		if (token->load()) {
-			return;
-		}
+void RenderingContext::videoTick(float seconds)
+{
+	TraceRecorder::setThreadName("graphics");
+	TraceScope trace("videoTick");
+
+	updateAnalyzerDemand();
 
-		auto &hsvxMatchTimerReader = self->hsvxMatchTimerReader;
+	const AnalysisScheduler::AnalyzerMask dueAnalyzers = analysisScheduler.tick(seconds);
+	if (dueAnalyzers != 0) {
+		analyzersToStage.fetch_or(dueAnalyzers);
+	}
+}
 
-		cv::Mat hsvxMatchTimerImage(hsvxMatchTimerReader.getHeight(), hsvxMatchTimerReader.getWidth(), CV_8UC4,
-					    static_cast<void *>(hsvxMatchTimerReader.getBuffer().data()));
-		cv::Mat vMatchTimerImage;
-		cv::extractChannel(hsvxMatchTimerImage, vMatchTimerImage, 2);
-	});
+void RenderingContext::updateAnalyzerDemand()
+{
+	// In-process consumers such as the shared-memory channel are counted by hasConsumers() too.
+	const bool contextClassifierWanted = webSocketServer->hasConsumers(WebSocketServer::Topic::Classifier) ||
+					     webSocketServer->hasConsumers(WebSocketServer::Topic::Scores);
+	const bool matchTimerWanted = webSocketServer->hasConsumers(WebSocketServer::Topic::Timer);
+
+	for (const auto &[analyzer, wanted] : {std::pair{contextClassifierAnalyzer, contextClassifierWanted},
+					       std::pair{matchTimerAnalyzer, matchTimerWanted}}) {
+		if (wanted && !analysisScheduler.isEnabled(analyzer)) {
+			// A new consumer needs a result even if the region has not changed.
+			changeMap.markDirty(analyzer);
+		}
+		analysisScheduler.setEnabled(analyzer, wanted);
+	}
+	analysisScheduler.setEnabled(changeDetectorAnalyzer, contextClassifierWanted || matchTimerWanted);
 }
 
 void RenderingContext::videoRender()
 {
-	if (doesNextVideoRenderReceiveNewFrame) {
-		doesNextVideoRenderReceiveNewFrame = false;
-		videoRenderNewFrame();
+	// Readers staged on the previous new frame are synced one frame later so that mapping does not stall.
+	if (analyzersToSync != 0) {
+		const AnalysisScheduler::AnalyzerMask analyzers = analyzersToSync;
+		analyzersToSync = 0;
+		dispatchAnalyzers(analyzers);
+	}
+
+	// Analyzers whose region is unchanged since they last ran are neither staged nor dispatched.
+	const AnalysisScheduler::AnalyzerMask dueAnalyzers = analyzersToStage.exchange(0);
+	const AnalysisScheduler::AnalyzerMask analyzers =
+		changeMap.takeChanged(dueAnalyzers, std::chrono::steady_clock::now());
+	if (analyzers != 0) {
+		PluginMetrics::instance().addFrameAnalyzed();
+		analyzersToSyncFrameTime = ThrottledTaskQueue::Clock::now();
+		gpuPassProfiler.beginFrame();
+		videoRenderNewFrame(analyzers);
+		gpuPassProfiler.endFrame();
+		analyzersToSync = analyzers;
+	} else if (dueAnalyzers != 0) {
+		PluginMetrics::instance().addFrameSkipped();
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now - lastStatsReportTime >= STATS_REPORT_INTERVAL) {
+		lastStatsReportTime = now;
+		gpuPassProfiler.logSummary(logger);
+		mainTaskQueue.logSummary(logger);
+		MemoryAccounting::instance().logSummary(logger);
+	}
+	if (now - lastStatsPublishTime >= STATS_PUBLISH_INTERVAL &&
+	    webSocketServer->hasConsumers(WebSocketServer::Topic::Stats)) {
+		lastStatsPublishTime = now;
+		publishStats();
 	}
 
 	obs_source_skip_video_filter(source);
 }
 
-void RenderingContext::videoRenderNewFrame()
+void RenderingContext::videoRenderNewFrame(AnalysisScheduler::AnalyzerMask analyzers)
 {
-	hsvxMatchTimerReader.sync();
+	TraceScope trace("videoRenderNewFrame");
+
+	if (bgrxSourceImage) {
+		auto scope = gpuPassProfiler.scope(GPU_PASS_DRAW_SOURCE);
+		mainEffect.drawSource(bgrxSourceImage, source);
+	}
+
+	{
+		auto scope = gpuPassProfiler.scope(GPU_PASS_FRAME_PYRAMID);
+		framePyramid.render(mainEffect, source, analyzers);
+	}
+
+	if (analyzers & AnalysisScheduler::toMask(changeDetectorAnalyzer)) {
+		auto &currentFrame = framePyramid.getTexture(FramePyramid::COARSEST_LEVEL);
+
+		{
+			auto scope = gpuPassProfiler.scope(GPU_PASS_TILE_DIFFERENCE);
+			mainEffect.computeTileDifference(r8ChangeMap, currentFrame, bgrxChangeDetectorPreviousFrame);
+		}
+		{
+			auto scope = gpuPassProfiler.scope(GPU_PASS_STAGE_CHANGE_MAP);
+			r8ChangeMapReader.stage(r8ChangeMap.get());
+		}
+
+		gs_copy_texture(bgrxChangeDetectorPreviousFrame.get(), currentFrame.get());
+	}
+
+	if (analyzers & AnalysisScheduler::toMask(matchTimerAnalyzer)) {
+		{
+			auto scope = gpuPassProfiler.scope(GPU_PASS_DRAW_MATCH_TIMER);
+			mainEffect.drawSourceRegion(bgrxMatchTimer, source, static_cast<float>(matchTimerRegion.x),
+						    static_cast<float>(matchTimerRegion.y),
+						    static_cast<float>(matchTimerRegion.width),
+						    static_cast<float>(matchTimerRegion.height));
+		}
+		{
+			auto scope = gpuPassProfiler.scope(GPU_PASS_CONVERT_MATCH_TIMER_TO_HSV);
+			mainEffect.convertToHSV(hsvxMatchTimer, bgrxMatchTimer);
+		}
+		{
+			auto scope = gpuPassProfiler.scope(GPU_PASS_STAGE_MATCH_TIMER);
+			hsvxMatchTimerReader.stage(hsvxMatchTimer.get());
+		}
+	}
+}
+
+void RenderingContext::dispatchAnalyzers(AnalysisScheduler::AnalyzerMask analyzers)
+{
+	// A result is worthless once several newer frames have been captured, so workers drop it unrun.
+	const std::chrono::duration<double> staleAfter(static_cast<double>(pluginConfig.staleFrameLimit) /
+						       std::max(1, analysisScheduler.getCaptureFps()));
+	const ThrottledTaskQueue::TaskTiming timing{
+		analyzersToSyncFrameTime,
+		analyzersToSyncFrameTime +
+			std::chrono::duration_cast<ThrottledTaskQueue::Clock::duration>(staleAfter)};
+
+	framePyramid.sync(analyzers);
+	PluginMetrics::instance().addReadbackBytes(framePyramid.getReadbackBytes(analyzers));
+
+	if (analyzers & AnalysisScheduler::toMask(changeDetectorAnalyzer)) {
+		syncReader(r8ChangeMapReader);
+		changeMap.update(r8ChangeMapReader.getBuffer().data(), r8ChangeMapReader.getBufferLinesize(),
+				 toChangeThreshold(pluginConfig.changeDetectionThreshold));
+	}
+
+	if (analyzers & AnalysisScheduler::toMask(contextClassifierAnalyzer)) {
+		mainTaskQueue.push("contextClassifier", timing, [self = shared_from_this()](
+							      const ThrottledTaskQueue::CancellationToken &token) {
+			if (token.isCancelled()) {
+				return;
+			}
+
+			TraceScope trace("contextClassifier task");
+			const auto inferenceStart = std::chrono::steady_clock::now();
+			self->contextClassifier.process(self->makeContextClassifierInput().data);
+			PluginMetrics::instance().recordInference(getElapsedNs(inferenceStart));
+
+			const std::vector<float> scores = self->contextClassifier.getScores();
+			SharedResultChannel &sharedResultChannel = SharedResultChannel::instance();
+			sharedResultChannel.writeScores(scores);
+
+			const bool classChanged = self->classDebouncer.update(scores);
+			const std::size_t currentClass = self->classDebouncer.getCurrentClass();
+			if (currentClass < contextClassifierClassNames.size()) {
+				// Shared-memory readers may attach at any time, so the record is refreshed on every
+				// inference while WebSocket clients only hear about changes.
+				sharedResultChannel.writeClassifier(static_cast<int>(currentClass),
+								    contextClassifierClassNames[currentClass]);
+				if (classChanged) {
+					self->webSocketServer->publish(WebSocketServer::Topic::Classifier,
+								       contextClassifierClassNames[currentClass]);
+				}
+			}
+
+			if (self->webSocketServer->hasConsumers(WebSocketServer::Topic::Scores)) {
+				json scoresJson = json::object();
+				const std::size_t count = std::min(scores.size(), contextClassifierClassNames.size());
+				for (std::size_t i = 0; i < count; i++) {
+					scoresJson[contextClassifierClassNames[i]] = scores[i];
+				}
+				self->webSocketServer->publish(WebSocketServer::Topic::Scores, std::move(scoresJson));
+			}
+		});
+	}
+
+	if (analyzers & AnalysisScheduler::toMask(matchTimerAnalyzer)) {
+		syncReader(hsvxMatchTimerReader);
+
+		mainTaskQueue.push("matchTimer", timing, [self = shared_from_this()](
+							      const ThrottledTaskQueue::CancellationToken &token) {
+			if (token.isCancelled()) {
+				return;
+			}
+
+			TraceScope trace("matchTimer task");
+			auto &hsvxMatchTimerReader = self->hsvxMatchTimerReader;
+
+			cv::Mat hsvxMatchTimerImage(hsvxMatchTimerReader.getHeight(), hsvxMatchTimerReader.getWidth(),
+						    CV_8UC4,
+						    static_cast<void *>(hsvxMatchTimerReader.getBuffer().data()),
+						    hsvxMatchTimerReader.getBufferLinesize());
+			cv::Mat vMatchTimerImage;
+			cv::extractChannel(hsvxMatchTimerImage, vMatchTimerImage, 2);
+
+			const auto ocrStart = std::chrono::steady_clock::now();
+			const std::string matchTimerText = self->matchTimerReader.read(vMatchTimerImage);
+			PluginMetrics::instance().recordOcr(getElapsedNs(ocrStart));
+			self->logger.debug("Match timer: {}", matchTimerText);
+			SharedResultChannel::instance().writeTimer(matchTimerText);
+			self->webSocketServer->publish(WebSocketServer::Topic::Timer, matchTimerText);
+		});
+	}
+}
+
+cv::Mat RenderingContext::makeContextClassifierInput()
+{
+	TraceScope trace("makeContextClassifierInput");
+	const FramePyramid::View view = framePyramid.getView(contextClassifierLevel);
+	const cv::Mat level(static_cast<int>(view.height), static_cast<int>(view.width), CV_8UC4,
+			    const_cast<std::uint8_t *>(view.data), view.linesize);
+
+	const RoiPosition &roi = efficientNetRoiPosition;
+	const cv::Size roiSize(static_cast<int>(roi.right - roi.left), static_cast<int>(roi.bottom - roi.top));
+	cv::Mat input(EFFICIENTNET_INPUT_HEIGHT, EFFICIENTNET_INPUT_WIDTH, CV_8UC4, cv::Scalar::all(0));
+	cv::Mat letterbox = input(cv::Rect(static_cast<int>(roi.left), static_cast<int>(roi.top), roiSize.width,
+					   roiSize.height));
+	cv::resize(level, letterbox, roiSize, 0, 0, cv::INTER_AREA);
+	return input;
+}
+
+void RenderingContext::publishStats()
+{
+	json stats;
+	stats["memoryBytes"] = MemoryAccounting::instance().getTotalBytes();
+
+	json gpuPasses = json::array();
+	for (std::size_t i = 0; i < gpuPassProfiler.getPassCount(); i++) {
+		const LatencyHistogram::Snapshot s = gpuPassProfiler.snapshot(i);
+		gpuPasses.push_back({{"name", gpuPassProfiler.getPassName(i)},
+				     {"count", s.count},
+				     {"p50Us", s.p50Ns / 1e3},
+				     {"p95Us", s.p95Ns / 1e3}});
+	}
+	stats["gpuPasses"] = std::move(gpuPasses);
+
+	json tasks = json::array();
+	for (const ThrottledTaskQueue::TaskStatsSnapshot &task : mainTaskQueue.snapshot()) {
+		tasks.push_back({{"key", std::string(task.key)},
+				 {"count", task.execNs.count},
+				 {"execP95Us", task.execNs.p95Ns / 1e3},
+				 {"waitP95Us", task.waitNs.p95Ns / 1e3},
+				 {"expired", task.expiredCount},
+				 {"replaced", task.replacedCount}});
+	}
+	stats["tasks"] = std::move(tasks);
 
-	mainEffect.drawSource(bgrxSourceImage, source);
-	mainEffect.convertToHSV(hsvxMatchTimer, bgrxSourceImage, static_cast<float>(matchTimerRegion.x),
-				static_cast<float>(matchTimerRegion.y));
+	stats["webSocket"] = {{"droppedMessages", webSocketServer->getDroppedMessageCount()},
+			      {"slowClientDisconnects", webSocketServer->getSlowClientDisconnectCount()}};
 
-	hsvxMatchTimerReader.stage(hsvxMatchTimer.get());
+	webSocketServer->publish(WebSocketServer::Topic::Stats, std::move(stats));
 }
 
 obs_source_frame *RenderingContext::filterVideo(obs_source_frame *frame)
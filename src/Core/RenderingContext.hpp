@@ -19,18 +19,28 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 
 #include <ncnn/net.h>
+#include <opencv2/core.hpp>
 
 #include "BridgeUtils/AsyncTextureReader.hpp"
+#include "BridgeUtils/GpuPassProfiler.hpp"
 #include "BridgeUtils/GsUnique.hpp"
 #include "BridgeUtils/ILogger.hpp"
 #include "BridgeUtils/ThrottledTaskQueue.hpp"
 
+#include "../Core/AnalysisScheduler.hpp"
+#include "../Core/ChangeMap.hpp"
+#include "../Core/ClassDebouncer.hpp"
+#include "../Core/CpuBudget.hpp"
+#include "../Core/FramePyramid.hpp"
 #include "../Core/MainEffect.hpp"
 #include "../Core/PluginConfig.hpp"
+#include "../EfficientNet/AccountingAllocator.hpp"
 #include "../EfficientNet/ContextClassifier.hpp"
+#include "../TesseractReader/MatchTimerReader.hpp"
 #include "../WebSocketServer/WebSocketServer.hpp"
 
 namespace KaitoTokyo {
@@ -65,35 +75,74 @@ public:
 
 	BridgeUtils::unique_gs_texture_t bgrxSourceImage;
 
+	/** Where the letterboxed frame goes in the classifier input. */
 	const RoiPosition efficientNetRoiPosition;
 
-	BridgeUtils::unique_gs_texture_t bgrxSceneDetectorInput;
-	BridgeUtils::AsyncTextureReader bgrxSceneDetectorInputReader;
-
 	const RenderingContextRegion matchTimerRegion;
 
+	BridgeUtils::unique_gs_texture_t bgrxMatchTimer;
 	BridgeUtils::unique_gs_texture_t hsvxMatchTimer;
 	BridgeUtils::AsyncTextureReader hsvxMatchTimerReader;
 
+	FramePyramid framePyramid;
+	/** The coarsest pyramid level that still covers the classifier input, read back for the classifier. */
+	const std::size_t contextClassifierLevel;
+
+	BridgeUtils::unique_gs_texture_t bgrxChangeDetectorPreviousFrame;
+	BridgeUtils::unique_gs_texture_t r8ChangeMap;
+	BridgeUtils::AsyncTextureReader r8ChangeMapReader;
+
 	std::uint64_t lastFrameTimestamp = 0;
-	std::atomic<bool> doesNextVideoRenderReceiveNewFrame = false;
 
+	AnalysisScheduler analysisScheduler;
+	const AnalysisScheduler::AnalyzerId changeDetectorAnalyzer;
+	const AnalysisScheduler::AnalyzerId contextClassifierAnalyzer;
+	const AnalysisScheduler::AnalyzerId matchTimerAnalyzer;
+
+	ChangeMap changeMap;
+
+	std::atomic<AnalysisScheduler::AnalyzerMask> analyzersToStage = 0;
+	AnalysisScheduler::AnalyzerMask analyzersToSync = 0;
+	BridgeUtils::ThrottledTaskQueue::Clock::time_point analyzersToSyncFrameTime;
+
+	CpuBudget::Lease ncnnThreadLease;
+	AccountingAllocator ncnnBlobAllocator;
+	AccountingAllocator ncnnWorkspaceAllocator;
 	ncnn::Net contextClassifierNet;
 	ContextClassifier contextClassifier;
+	ClassDebouncer classDebouncer;
+
+	MatchTimerReader matchTimerReader;
+
+	BridgeUtils::GpuPassProfiler gpuPassProfiler;
+	std::chrono::steady_clock::time_point lastStatsReportTime;
+	std::chrono::steady_clock::time_point lastStatsPublishTime;
 
 public:
 	RenderingContext(obs_source_t *source, const BridgeUtils::ILogger &logger,
 			 BridgeUtils::unique_gs_effect_t gsMainEffect, std::shared_ptr<WebSocketServer> webSocketServer,
 			 BridgeUtils::ThrottledTaskQueue &mainTaskQueue, PluginConfig pluginConfig, std::uint32_t width,
-			 std::uint32_t height);
+			 std::uint32_t height, int captureFps);
 	~RenderingContext() noexcept;
 
+	void setCaptureFps(int captureFps);
+
 	void videoTick(float seconds);
 	void videoRender();
 	obs_source_frame *filterVideo(obs_source_frame *frame);
 
 private:
-	void videoRenderNewFrame();
+	/**
+	 * @brief Enables only the analyzers whose topics have consumers, so unwatched results cost nothing.
+	 */
+	void updateAnalyzerDemand();
+	void videoRenderNewFrame(AnalysisScheduler::AnalyzerMask analyzers);
+	void dispatchAnalyzers(AnalysisScheduler::AnalyzerMask analyzers);
+	/**
+	 * @brief Letterboxes the classifier's pyramid level into the 224x224 BGRX input of the classifier.
+	 */
+	cv::Mat makeContextClassifierInput();
+	void publishStats();
 };
 
 } // namespace LiveUniteTools
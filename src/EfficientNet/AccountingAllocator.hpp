@@ -0,0 +1,138 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <net.h>
+
+#include "../BridgeUtils/MemoryAccounting.hpp"
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @class AccountingAllocator
+ * @brief An ncnn allocator that caches freed blocks by size and reports every byte it holds to MemoryAccounting.
+ *
+ * Requests are rounded up to a bucket size, and a freed block stays cached on its bucket's free list until clear().
+ * Bytes are counted when a block is really allocated and when clear() releases it, so the NcnnAllocator figure
+ * includes the cached blocks, which ncnn::PoolAllocator would keep out of sight.
+ * Each block is prefixed with a header holding its bucket size, as large as ncnn's malloc alignment.
+ * The free lists are locked, so one instance may serve concurrent extractors.
+ */
+class AccountingAllocator : public ncnn::Allocator {
+public:
+	static constexpr std::size_t HEADER_SIZE = 64;
+	static constexpr std::size_t MIN_BUCKET_SIZE = 256;
+
+private:
+	std::mutex mtx;
+	std::map<std::size_t, std::vector<std::uint8_t *>> freeBlocks;
+
+	/**
+	 * @brief Rounds a request up to the next quarter of a power of two, wasting at most a fifth of a block.
+	 */
+	static std::size_t getBucketSize(std::size_t size) noexcept
+	{
+		if (size <= MIN_BUCKET_SIZE) {
+			return MIN_BUCKET_SIZE;
+		}
+		std::size_t octave = MIN_BUCKET_SIZE;
+		while (octave <= size / 2) {
+			octave *= 2;
+		}
+		const std::size_t step = octave / 4;
+		return (size + step - 1) / step * step;
+	}
+
+	static void account(std::int64_t bytes) noexcept
+	{
+		BridgeUtils::MemoryAccounting::instance().add(BridgeUtils::MemoryAccounting::Category::NcnnAllocator,
+							       bytes);
+	}
+
+public:
+	AccountingAllocator() = default;
+	~AccountingAllocator() override { clear(); }
+
+	AccountingAllocator(const AccountingAllocator &) = delete;
+	AccountingAllocator &operator=(const AccountingAllocator &) = delete;
+
+	void *fastMalloc(std::size_t size) override
+	{
+		const std::size_t bucketSize = getBucketSize(size);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto it = freeBlocks.find(bucketSize);
+			if (it != freeBlocks.end() && !it->second.empty()) {
+				std::uint8_t *block = it->second.back();
+				it->second.pop_back();
+				return block + HEADER_SIZE;
+			}
+		}
+
+		auto *block = static_cast<std::uint8_t *>(ncnn::fastMalloc(bucketSize + HEADER_SIZE));
+		if (!block) {
+			return nullptr;
+		}
+		*reinterpret_cast<std::size_t *>(block) = bucketSize;
+		account(static_cast<std::int64_t>(bucketSize + HEADER_SIZE));
+		return block + HEADER_SIZE;
+	}
+
+	void fastFree(void *ptr) override
+	{
+		if (!ptr) {
+			return;
+		}
+		std::uint8_t *block = static_cast<std::uint8_t *>(ptr) - HEADER_SIZE;
+		const std::size_t bucketSize = *reinterpret_cast<std::size_t *>(block);
+		std::lock_guard<std::mutex> lock(mtx);
+		freeBlocks[bucketSize].push_back(block);
+	}
+
+	/**
+	 * @brief Releases every cached block. Blocks still handed out stay allocated and counted.
+	 */
+	void clear()
+	{
+		std::map<std::size_t, std::vector<std::uint8_t *>> released;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			released.swap(freeBlocks);
+		}
+
+		std::int64_t releasedBytes = 0;
+		for (const auto &[bucketSize, blocks] : released) {
+			for (std::uint8_t *block : blocks) {
+				ncnn::fastFree(block);
+			}
+			releasedBytes += static_cast<std::int64_t>((bucketSize + HEADER_SIZE) * blocks.size());
+		}
+		account(-releasedBytes);
+	}
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -21,6 +21,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cmath>
 #include <iterator>
 
 #include <net.h>
@@ -54,6 +55,29 @@ public:
 		auto index = std::distance(logits.begin(), maxIt);
 		return contextClassifierClassNames[index];
 	}
+
+	/**
+	 * @brief Gets the softmax probabilities of the classes, in the order of contextClassifierClassNames.
+	 */
+	std::vector<float> getScores()
+	{
+		const auto &logits = efficientNet.getOutputBuffer();
+		std::vector<float> scores(logits.begin(), logits.end());
+		if (scores.empty()) {
+			return scores;
+		}
+
+		const float maxLogit = *std::max_element(scores.begin(), scores.end());
+		float sum = 0.0f;
+		for (float &score : scores) {
+			score = std::exp(score - maxLogit);
+			sum += score;
+		}
+		for (float &score : scores) {
+			score /= sum;
+		}
+		return scores;
+	}
 };
 
 } // namespace LiveUniteTools
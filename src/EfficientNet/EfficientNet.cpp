@@ -21,6 +21,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <cstddef>
 #include <vector>
 
+#include "../BridgeUtils/TraceRecorder.hpp"
+
+using namespace KaitoTokyo::BridgeUtils;
+
 namespace KaitoTokyo {
 namespace LiveUniteTools {
 
@@ -169,6 +173,8 @@ void EfficientNet::process(const std::uint8_t *bgra_data)
 		return;
 	}
 
+	TraceScope trace("EfficientNet::process");
+
 	preprocess(bgra_data);
 
 	ncnn::Extractor ex = efficientNet.create_extractor();
@@ -0,0 +1,165 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SharedResultChannel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+static_assert(sizeof(lur_record) == 256, "A record must stay four cache lines long");
+static_assert(sizeof(lur_classifier_value) <= LUR_RECORD_VALUE_SIZE);
+static_assert(sizeof(lur_timer_value) <= LUR_RECORD_VALUE_SIZE);
+static_assert(sizeof(lur_scores_value) <= LUR_RECORD_VALUE_SIZE);
+
+SharedResultChannel::~SharedResultChannel() noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	close();
+}
+
+bool SharedResultChannel::acquire() noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (userCount == 0 && !open()) {
+		return false;
+	}
+	userCount++;
+	return true;
+}
+
+void SharedResultChannel::release() noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (userCount > 0 && --userCount == 0) {
+		close();
+	}
+}
+
+#ifndef _WIN32
+
+bool SharedResultChannel::open() noexcept
+{
+	const int fd = shm_open(LUR_SHM_NAME, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, sizeof(lur_results)) != 0) {
+		::close(fd);
+		shm_unlink(LUR_SHM_NAME);
+		return false;
+	}
+	void *mapped = mmap(nullptr, sizeof(lur_results), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		shm_unlink(LUR_SHM_NAME);
+		return false;
+	}
+
+	// A region left behind by a crashed process may hold odd sequences, so start from scratch.
+	std::memset(mapped, 0, sizeof(lur_results));
+	results = static_cast<lur_results *>(mapped);
+	results->record_count = LUR_RECORD_COUNT;
+	results->record_size = sizeof(lur_record);
+	results->version = LUR_VERSION;
+	results->writer_state = LUR_WRITER_ALIVE;
+	// Readers check the magic first, so publish it last.
+	__atomic_store_n(&results->magic, LUR_MAGIC, __ATOMIC_RELEASE);
+
+	enabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void SharedResultChannel::close() noexcept
+{
+	if (!results) {
+		return;
+	}
+
+	// Readers keep their mapping after the unlink, so tell them that nothing will be written to it anymore.
+	__atomic_store_n(&results->writer_state, LUR_WRITER_CLOSED, __ATOMIC_RELEASE);
+	munmap(results, sizeof(lur_results));
+	shm_unlink(LUR_SHM_NAME);
+	results = nullptr;
+	enabled.store(false, std::memory_order_relaxed);
+}
+
+void SharedResultChannel::write(lur_record_id id, const void *value, std::size_t valueSize) noexcept
+{
+	const std::int64_t timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+						 std::chrono::system_clock::now().time_since_epoch())
+						 .count();
+
+	std::lock_guard<std::mutex> lock(mtx);
+	if (!results) {
+		return;
+	}
+
+	lur_record &record = results->records[id];
+	const std::uint32_t sequence = __atomic_load_n(&record.sequence, __ATOMIC_RELAXED);
+	__atomic_store_n(&record.sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	std::memcpy(record.value, value, valueSize);
+	record.value_size = static_cast<std::uint32_t>(valueSize);
+	__atomic_store_n(&record.timestamp_ms, timestampMs, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&record.sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool SharedResultChannel::open() noexcept
+{
+	return false;
+}
+
+void SharedResultChannel::close() noexcept {}
+
+void SharedResultChannel::write(lur_record_id, const void *, std::size_t) noexcept {}
+
+#endif
+
+void SharedResultChannel::writeClassifier(int classIndex, std::string_view className) noexcept
+{
+	lur_classifier_value value{};
+	value.class_index = classIndex;
+	className.copy(value.class_name, std::min<std::size_t>(className.size(), LUR_TEXT_SIZE - 1));
+	write(LUR_RECORD_CLASSIFIER, &value, sizeof(value));
+}
+
+void SharedResultChannel::writeTimer(std::string_view text) noexcept
+{
+	lur_timer_value value{};
+	text.copy(value.text, std::min<std::size_t>(text.size(), LUR_TEXT_SIZE - 1));
+	write(LUR_RECORD_TIMER, &value, sizeof(value));
+}
+
+void SharedResultChannel::writeScores(const std::vector<float> &scores) noexcept
+{
+	lur_scores_value value{};
+	value.count = static_cast<std::uint32_t>(std::min<std::size_t>(scores.size(), LUR_MAX_CLASSES));
+	std::copy_n(scores.begin(), value.count, value.scores);
+	write(LUR_RECORD_SCORES, &value, sizeof(value));
+}
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
@@ -0,0 +1,85 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "live_unite_results.h"
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief Publishes the latest results into a shared-memory region for local consumers.
+ *
+ * See live_unite_results.h for the layout and the reader. Every record is a seqlock, so readers in other
+ * processes never block the writer. Writes are serialized by a mutex that also keeps the region mapped
+ * while a write is in progress. The region is process-wide, so every filter that wants it acquires it and
+ * it exists while any filter holds it. It is marked closed before it is removed.
+ *
+ * The channel is POSIX only; on Windows acquire() fails.
+ */
+class SharedResultChannel {
+private:
+	std::atomic<bool> enabled = false;
+	std::mutex mtx;
+	int userCount = 0;
+	lur_results *results = nullptr;
+
+	SharedResultChannel() = default;
+
+public:
+	static SharedResultChannel &instance()
+	{
+		static SharedResultChannel channel;
+		return channel;
+	}
+
+	SharedResultChannel(const SharedResultChannel &) = delete;
+	SharedResultChannel &operator=(const SharedResultChannel &) = delete;
+	~SharedResultChannel() noexcept;
+
+	/**
+	 * @brief Registers a user of the region, creating the region for the first one.
+	 * @return Whether the region exists. A failed call registers nothing.
+	 */
+	bool acquire() noexcept;
+
+	/**
+	 * @brief Unregisters a user, removing the region with the last one.
+	 */
+	void release() noexcept;
+
+	bool isEnabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
+
+	void writeClassifier(int classIndex, std::string_view className) noexcept;
+	void writeTimer(std::string_view text) noexcept;
+	void writeScores(const std::vector<float> &scores) noexcept;
+
+private:
+	bool open() noexcept;
+	void close() noexcept;
+	void write(lur_record_id id, const void *value, std::size_t valueSize) noexcept;
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
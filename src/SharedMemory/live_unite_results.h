@@ -0,0 +1,200 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The layout of the shared-memory result channel and a header-only reader for it.
+ *
+ * The plugin publishes the latest classifier, timer and score values into the POSIX shared-memory object
+ * LUR_SHM_NAME. Every record is guarded by its own seqlock: the writer makes the sequence odd, writes the
+ * value and makes the sequence even again. Readers copy the record and retry if the sequence was odd or
+ * changed meanwhile, so reading never takes a lock, makes a syscall or parses anything.
+ *
+ * A minimal reader:
+ *
+ *     struct lur_results *results = lur_results_open();
+ *     struct lur_timer_value timer;
+ *     if (results && lur_results_read(results, LUR_RECORD_TIMER, &timer, sizeof(timer)) > 0)
+ *             printf("%s\n", timer.text);
+ *     lur_results_close(results);
+ *
+ * The plugin marks the region closed before removing it, e.g. when the last filter using it is turned off.
+ * A reader that finds lur_results_writer_alive() false should close the region and open it again later.
+ * A writer that crashed leaves the region marked alive, so readers that care should also watch timestamps.
+ *
+ * The channel is POSIX only. The header is plain C99 and relies on the GCC/Clang __atomic builtins.
+ */
+
+#ifndef LIVE_UNITE_RESULTS_H
+#define LIVE_UNITE_RESULTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LUR_SHM_NAME "/live-unite-tools-results"
+#define LUR_MAGIC 0x5255554cu /* "LUUR" */
+#define LUR_VERSION 1u
+
+#define LUR_RECORD_VALUE_SIZE 240u
+#define LUR_MAX_CLASSES 32u
+#define LUR_TEXT_SIZE 64u
+
+#define LUR_WRITER_ALIVE 1u
+#define LUR_WRITER_CLOSED 2u
+
+enum lur_record_id {
+	LUR_RECORD_CLASSIFIER = 0,
+	LUR_RECORD_TIMER = 1,
+	LUR_RECORD_SCORES = 2,
+	LUR_RECORD_COUNT = 3,
+};
+
+/* The value of LUR_RECORD_CLASSIFIER: the debounced class. */
+struct lur_classifier_value {
+	int32_t class_index;
+	char class_name[LUR_TEXT_SIZE];
+};
+
+/* The value of LUR_RECORD_TIMER: the OCR text of the match timer. */
+struct lur_timer_value {
+	char text[LUR_TEXT_SIZE];
+};
+
+/* The value of LUR_RECORD_SCORES: the softmax score of every class, in class index order. */
+struct lur_scores_value {
+	uint32_t count;
+	float scores[LUR_MAX_CLASSES];
+};
+
+/* One seqlock-guarded record, four cache lines long. */
+struct lur_record {
+	/* Odd while the writer is updating the record. Zero until the first value is written. */
+	uint32_t sequence;
+	uint32_t value_size;
+	/* Unix time in milliseconds at which the value was produced. */
+	int64_t timestamp_ms;
+	unsigned char value[LUR_RECORD_VALUE_SIZE];
+};
+
+struct lur_results {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_count;
+	uint32_t record_size;
+	/* LUR_WRITER_ALIVE while the plugin writes to the region, LUR_WRITER_CLOSED once it has let go of it. */
+	uint32_t writer_state;
+	unsigned char reserved[44];
+	struct lur_record records[LUR_RECORD_COUNT];
+};
+
+#ifndef _WIN32
+
+/*
+ * Copies the latest value of a record.
+ * Returns the record's sequence (positive) on success, 0 if nothing was written yet,
+ * or -1 if the writer kept the record busy for too long.
+ */
+static inline int64_t lur_results_read(const struct lur_results *results, enum lur_record_id id, void *value,
+				       size_t value_size)
+{
+	const struct lur_record *record = &results->records[id];
+	if (value_size > LUR_RECORD_VALUE_SIZE)
+		value_size = LUR_RECORD_VALUE_SIZE;
+
+	for (int attempt = 0; attempt < 1000; attempt++) {
+		const uint32_t before = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+		if (before == 0)
+			return 0;
+		if (before & 1u)
+			continue;
+
+		memcpy(value, (const void *)record->value, value_size);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == before)
+			return before;
+	}
+	return -1;
+}
+
+/* Returns the timestamp of the latest value of a record, read under the same rules as lur_results_read. */
+static inline int64_t lur_results_read_timestamp(const struct lur_results *results, enum lur_record_id id)
+{
+	const struct lur_record *record = &results->records[id];
+	for (int attempt = 0; attempt < 1000; attempt++) {
+		const uint32_t before = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+		if (before & 1u)
+			continue;
+		const int64_t timestamp_ms = __atomic_load_n(&record->timestamp_ms, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == before)
+			return timestamp_ms;
+	}
+	return -1;
+}
+
+/* Returns whether the plugin still writes to the region. */
+static inline int lur_results_writer_alive(const struct lur_results *results)
+{
+	return __atomic_load_n(&results->writer_state, __ATOMIC_ACQUIRE) == LUR_WRITER_ALIVE;
+}
+
+/* Maps the channel read-only. Returns NULL if the plugin is not publishing or the layout is incompatible. */
+static inline struct lur_results *lur_results_open(void)
+{
+	const int fd = shm_open(LUR_SHM_NAME, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+
+	void *mapped = mmap(NULL, sizeof(struct lur_results), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		return NULL;
+
+	struct lur_results *results = (struct lur_results *)mapped;
+	if (results->magic != LUR_MAGIC || results->version != LUR_VERSION ||
+	    results->record_size != sizeof(struct lur_record)) {
+		munmap(mapped, sizeof(struct lur_results));
+		return NULL;
+	}
+	return results;
+}
+
+static inline void lur_results_close(struct lur_results *results)
+{
+	if (results)
+		munmap(results, sizeof(struct lur_results));
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,7 +18,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "MatchTimerReader.hpp"
 
+#include <memory>
+#include <stdexcept>
+
 #include "../BridgeUtils/ObsUnique.hpp"
+#include "../BridgeUtils/TraceRecorder.hpp"
 
 using namespace KaitoTokyo::BridgeUtils;
 
@@ -44,9 +48,12 @@ try {
 
 std::string MatchTimerReader::read(cv::Mat &lumaData)
 {
+	TraceScope trace("MatchTimerReader::read");
+
 	api.SetImage(lumaData.data, static_cast<int>(lumaData.cols), static_cast<int>(lumaData.rows), 1,
 		     static_cast<int>(lumaData.step));
-	return api.GetUTF8Text();
+	std::unique_ptr<char[]> text(api.GetUTF8Text());
+	return text ? std::string(text.get()) : std::string();
 }
 
 } // namespace LiveUniteTools
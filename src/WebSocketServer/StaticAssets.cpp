@@ -0,0 +1,152 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "StaticAssets.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+namespace {
+
+std::string getContentType(const std::filesystem::path &path)
+{
+	const std::string extension = path.extension().string();
+	if (extension == ".html") {
+		return "text/html; charset=utf-8";
+	} else if (extension == ".js") {
+		return "text/javascript; charset=utf-8";
+	} else if (extension == ".css") {
+		return "text/css; charset=utf-8";
+	} else if (extension == ".json") {
+		return "application/json";
+	} else if (extension == ".png") {
+		return "image/png";
+	} else if (extension == ".svg") {
+		return "image/svg+xml";
+	} else if (extension == ".webp") {
+		return "image/webp";
+	} else {
+		return "application/octet-stream";
+	}
+}
+
+std::string makeEtag(const std::string &body)
+{
+	// FNV-1a is enough to tell versions of a local file apart.
+	std::uint64_t hash = 14695981039346656037ull;
+	for (const char c : body) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ull;
+	}
+
+	static constexpr char HEX[] = "0123456789abcdef";
+	std::string etag = "\"";
+	for (int shift = 60; shift >= 0; shift -= 4) {
+		etag += HEX[(hash >> shift) & 0xf];
+	}
+	etag += '"';
+	return etag;
+}
+
+std::string gzip(const std::string &body)
+{
+	z_stream stream{};
+	// 15 + 16 selects a gzip header instead of a zlib one.
+	if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("deflateInit2 failed");
+	}
+
+	std::string compressed(deflateBound(&stream, static_cast<uLong>(body.size())), '\0');
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.data()));
+	stream.avail_in = static_cast<uInt>(body.size());
+	stream.next_out = reinterpret_cast<Bytef *>(compressed.data());
+	stream.avail_out = static_cast<uInt>(compressed.size());
+	const int result = deflate(&stream, Z_FINISH);
+	const uLong totalOut = stream.total_out;
+	deflateEnd(&stream);
+
+	if (result != Z_STREAM_END) {
+		throw std::runtime_error("deflate failed");
+	}
+	compressed.resize(totalOut);
+	return compressed;
+}
+
+} // namespace
+
+StaticAssets StaticAssets::load(const std::string &directory)
+{
+	StaticAssets staticAssets;
+
+	const std::filesystem::path root(directory);
+	for (const auto &entry : std::filesystem::recursive_directory_iterator(root)) {
+		if (!entry.is_regular_file()) {
+			continue;
+		}
+
+		std::ifstream file(entry.path(), std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Failed to read " + entry.path().string());
+		}
+
+		Asset asset;
+		asset.body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		asset.contentType = getContentType(entry.path());
+		// Pages are revalidated on every load so that overlay edits show up. Other assets are reused for a day
+		// and then revalidated with the ETag.
+		asset.cacheControl = entry.path().extension() == ".html" ? "no-cache" : "public, max-age=86400";
+		asset.etag = makeEtag(asset.body);
+
+		std::string compressed = gzip(asset.body);
+		if (compressed.size() < asset.body.size() * 9 / 10) {
+			asset.gzipBody = std::move(compressed);
+			asset.gzipEtag = asset.etag.substr(0, asset.etag.size() - 1) + "-gz\"";
+		}
+
+		const std::string urlPath = "/" + entry.path().lexically_relative(root).generic_string();
+		staticAssets.assets.emplace(urlPath, std::move(asset));
+	}
+
+	return staticAssets;
+}
+
+const StaticAssets::Asset *StaticAssets::find(std::string_view urlPath) const
+{
+	const auto it = assets.find(std::string(urlPath));
+	return it == assets.end() ? nullptr : &it->second;
+}
+
+std::size_t StaticAssets::getTotalBytes() const noexcept
+{
+	std::size_t totalBytes = 0;
+	for (const auto &[path, asset] : assets) {
+		totalBytes += asset.body.size() + asset.gzipBody.size();
+	}
+	return totalBytes;
+}
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
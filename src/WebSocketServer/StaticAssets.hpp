@@ -0,0 +1,70 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace KaitoTokyo {
+namespace LiveUniteTools {
+
+/**
+ * @brief An immutable in-memory copy of a directory of overlay assets, ready to be served over HTTP.
+ *
+ * Every file is read once, given a strong ETag, and precompressed with gzip when that makes it smaller.
+ * The gzip body is a different representation, so it gets its own ETag.
+ * Lookups are by the path relative to the directory with forward slashes, so paths outside the directory
+ * can never be served.
+ */
+class StaticAssets {
+public:
+	struct Asset {
+		std::string contentType;
+		std::string cacheControl;
+		std::string etag;
+		std::string body;
+		/** The gzip-compressed body, or empty when compression does not pay off. */
+		std::string gzipBody;
+		/** The ETag of gzipBody, or empty with it. */
+		std::string gzipEtag;
+	};
+
+	/**
+	 * @brief Loads every regular file under a directory.
+	 * @throws std::runtime_error if a file cannot be read or compressed.
+	 */
+	static StaticAssets load(const std::string &directory);
+
+	/**
+	 * @return The asset at a URL path such as `/particles.html`, or nullptr.
+	 */
+	const Asset *find(std::string_view urlPath) const;
+
+	std::size_t getAssetCount() const noexcept { return assets.size(); }
+
+	std::size_t getTotalBytes() const noexcept;
+
+private:
+	std::unordered_map<std::string, Asset> assets;
+};
+
+} // namespace LiveUniteTools
+} // namespace KaitoTokyo
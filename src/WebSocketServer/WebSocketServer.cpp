@@ -18,53 +18,316 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "WebSocketServer.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <future>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../BridgeUtils/MemoryAccounting.hpp"
+#include "../BridgeUtils/TraceRecorder.hpp"
+
+using namespace KaitoTokyo::BridgeUtils;
+using json = nlohmann::json;
 
 namespace KaitoTokyo {
 namespace LiveUniteTools {
 
-std::shared_ptr<WebSocketServer> WebSocketServer::getSharedWebSocketServer()
+namespace {
+
+std::mutex &getSharedServerMutex()
 {
 	static std::mutex mtx;
+	return mtx;
+}
+
+WebSocketServer::Config &getSharedServerConfig()
+{
+	static WebSocketServer::Config config;
+	return config;
+}
+
+bool parseBackpressurePolicy(std::string_view name, WebSocketServer::BackpressurePolicy &policy) noexcept
+{
+	if (name == "drop") {
+		policy = WebSocketServer::BackpressurePolicy::Drop;
+	} else if (name == "keepLatest") {
+		policy = WebSocketServer::BackpressurePolicy::KeepLatest;
+	} else if (name == "disconnect") {
+		policy = WebSocketServer::BackpressurePolicy::Disconnect;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief The CPU time of the calling thread. /metrics is served on the loop thread, so this measures the loop.
+ */
+double getCurrentThreadCpuSeconds() noexcept
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return 0.0;
+	}
+	const auto toTicks = [](const FILETIME &time) {
+		return (static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	};
+	// FILETIME counts 100 ns ticks.
+	return static_cast<double>(toTicks(kernelTime) + toTicks(userTime)) / 1e7;
+#else
+	timespec time;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+		return 0.0;
+	}
+	return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+#endif
+}
+
+/**
+ * @brief Whether an If-None-Match list names an ETag, comparing weakly as RFC 9110 asks for that header.
+ */
+bool matchesEtag(std::string_view ifNoneMatch, std::string_view etag) noexcept
+{
+	if (etag.empty()) {
+		return false;
+	}
+	while (!ifNoneMatch.empty()) {
+		const std::size_t comma = ifNoneMatch.find(',');
+		std::string_view candidate = ifNoneMatch.substr(0, comma);
+		ifNoneMatch = comma == std::string_view::npos ? std::string_view() : ifNoneMatch.substr(comma + 1);
+
+		while (!candidate.empty() && (candidate.front() == ' ' || candidate.front() == '\t')) {
+			candidate.remove_prefix(1);
+		}
+		while (!candidate.empty() && (candidate.back() == ' ' || candidate.back() == '\t')) {
+			candidate.remove_suffix(1);
+		}
+		if (candidate.substr(0, 2) == "W/") {
+			candidate.remove_prefix(2);
+		}
+		if (candidate == "*" || candidate == etag) {
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+std::shared_ptr<WebSocketServer> WebSocketServer::getSharedWebSocketServer()
+{
 	static std::shared_ptr<WebSocketServer> instance;
-	std::lock_guard<std::mutex> lock(mtx);
+	std::lock_guard<std::mutex> lock(getSharedServerMutex());
 	if (!instance) {
-		instance = std::make_shared<WebSocketServer>();
+		instance = std::make_shared<WebSocketServer>(getSharedServerConfig());
 	}
 	return instance;
 }
 
-WebSocketServer::WebSocketServer()
+void WebSocketServer::configure(const Config &config)
+{
+	std::lock_guard<std::mutex> lock(getSharedServerMutex());
+	getSharedServerConfig() = config;
+}
+
+WebSocketServer::Config WebSocketServer::loadConfig(const char *path)
+{
+	Config config;
+
+	std::ifstream file(path);
+	if (!file) {
+		return config;
+	}
+
+	const json j = json::parse(file, nullptr, false);
+	if (j.is_discarded() || !j.is_object()) {
+		throw std::runtime_error("Failed to parse WebSocket server configuration");
+	}
+
+	config.port = j.value("port", config.port);
+	config.maxBackpressureBytes = j.value("maxBackpressureKiB", config.maxBackpressureBytes / 1024) * 1024;
+	if (j.contains("topics") && j["topics"].is_object()) {
+		for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+			const char *name = getTopicName(static_cast<Topic>(i));
+			if (!j["topics"].contains(name)) {
+				continue;
+			}
+			const json &topicJson = j["topics"][name];
+			TopicConfig &topic = config.topics[i];
+			if (!parseBackpressurePolicy(topicJson.value("policy", std::string()), topic.policy)) {
+				throw std::runtime_error(std::string("Unknown backpressure policy for topic ") + name);
+			}
+			topic.highWatermarkBytes =
+				topicJson.value("highWatermarkKiB", topic.highWatermarkBytes / 1024) * 1024;
+		}
+	}
+
+	return config;
+}
+
+const char *WebSocketServer::getTopicName(Topic topic) noexcept
+{
+	switch (topic) {
+	case Topic::Classifier:
+		return "classifier";
+	case Topic::Timer:
+		return "timer";
+	case Topic::Scores:
+		return "scores";
+	case Topic::Stats:
+		return "stats";
+	default:
+		return "unknown";
+	}
+}
+
+bool WebSocketServer::parseTopic(std::string_view name, Topic &topic) noexcept
+{
+	for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+		if (name == getTopicName(static_cast<Topic>(i))) {
+			topic = static_cast<Topic>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *WebSocketServer::getFormatName(Format format) noexcept
+{
+	switch (format) {
+	case Format::Text:
+		return "text";
+	case Format::Json:
+		return "json";
+	case Format::MessagePack:
+		return "msgpack";
+	default:
+		return "unknown";
+	}
+}
+
+bool WebSocketServer::parseFormat(std::string_view name, Format &format) noexcept
+{
+	for (std::size_t i = 0; i < FORMAT_COUNT; i++) {
+		if (name == getFormatName(static_cast<Format>(i))) {
+			format = static_cast<Format>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+const std::string &WebSocketServer::getChannelName(Topic topic, Format format)
+{
+	static const std::array<std::array<std::string, FORMAT_COUNT>, TOPIC_COUNT> channelNames = [] {
+		std::array<std::array<std::string, FORMAT_COUNT>, TOPIC_COUNT> names;
+		for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+			// Text keeps the bare topic name so that the uWS topics of existing clients do not change.
+			names[i][0] = getTopicName(static_cast<Topic>(i));
+			for (std::size_t j = 1; j < FORMAT_COUNT; j++) {
+				names[i][j] = names[i][0] + "." + getFormatName(static_cast<Format>(j));
+			}
+		}
+		return names;
+	}();
+	return channelNames[static_cast<std::size_t>(topic)][static_cast<std::size_t>(format)];
+}
+
+WebSocketServer::WebSocketServer(const Config &_config) : config(_config)
 {
 	std::promise<uWS::Loop *> loopPromise;
 	auto loopFuture = loopPromise.get_future();
 
 	serverThread = std::thread([this, p = std::move(loopPromise)]() mutable {
+		TraceRecorder::setThreadName("WebSocketServer");
 		uWS::Loop *threadLoop = uWS::Loop::get();
+
+		uWS::App threadApp;
+		app = &threadApp;
 		p.set_value(threadLoop);
 
 		uWS::TemplatedApp<false>::WebSocketBehavior<UserData> behavior;
+		behavior.maxBackpressure = config.maxBackpressureBytes;
+		behavior.closeOnBackpressureLimit = true;
+		behavior.upgrade = [](auto *res, auto *req, auto *context) {
+			UserData userData;
+			std::string_view topics = req->getQuery("topics");
+			while (!topics.empty()) {
+				const std::size_t comma = topics.find(',');
+				Topic topic;
+				if (parseTopic(topics.substr(0, comma), topic)) {
+					userData.topics |= toMask(topic);
+				}
+				topics = comma == std::string_view::npos ? std::string_view{}
+									  : topics.substr(comma + 1);
+			}
+			if (userData.topics == 0) {
+				userData.topics = toMask(Topic::Classifier);
+			}
+			parseFormat(req->getQuery("format"), userData.format);
+
+			res->template upgrade<UserData>(std::move(userData), req->getHeader("sec-websocket-key"),
+							req->getHeader("sec-websocket-protocol"),
+							req->getHeader("sec-websocket-extensions"), context);
+		};
 		behavior.open = [this](auto *ws) {
-			std::lock_guard<std::mutex> lock(clientsMutex);
+			for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+				if (ws->getUserData()->topics & toMask(static_cast<Topic>(i))) {
+					subscribe(ws, static_cast<Topic>(i));
+				}
+			}
 			clients.insert(ws);
+			updateSubscribedTopics();
+		};
+		behavior.message = [this](auto *ws, std::string_view message, uWS::OpCode opCode) {
+			if (opCode == uWS::OpCode::TEXT) {
+				handleMessage(ws, message);
+			}
+		};
+		behavior.drain = [this](auto *ws) {
+			ws->getUserData()->bufferedBytes = ws->getBufferedAmount();
+			resumeClient(ws);
 		};
 		behavior.close = [this](auto *ws, int, std::string_view) {
-			std::lock_guard<std::mutex> lock(clientsMutex);
 			clients.erase(ws);
+			accountSendBuffers();
+			updateSubscribedTopics();
 		};
 
-		uWS::App()
-			.ws<UserData>("/", std::move(behavior))
-			.listen(54834,
-				[this](auto *token) {
+		threadApp.ws<UserData>("/", std::move(behavior));
+		threadApp.get("/metrics", [this](auto *res, auto *) { serveMetrics(res); });
+		if (config.assets) {
+			// The WebSocket route yields plain GET requests to this one.
+			threadApp.get("/*", [this](auto *res, auto *req) { serveAsset(res, req); });
+		}
+		threadApp
+			.listen(config.port,
+				[this, threadLoop](auto *token) {
 					if (token) {
 						this->listenSocket = token;
+						// Created only on success, as the timer keeps the loop alive.
+						createFlushTimer(threadLoop);
 						this->running = true;
 					} else {
 						this->running = false;
 					}
 				})
 			.run();
+
+		app = nullptr;
 	});
 
 	loop = loopFuture.get();
@@ -78,8 +341,13 @@ WebSocketServer::~WebSocketServer()
 				if (listenSocket) {
 					us_listen_socket_close(0, listenSocket);
 				}
-				std::lock_guard<std::mutex> lock(clientsMutex);
-				for (auto *ws : clients) {
+				if (flushTimer) {
+					us_timer_close(flushTimer);
+					flushTimer = nullptr;
+				}
+				// end() runs the close handler, which erases from clients.
+				const std::vector<WebSocket *> closing(clients.begin(), clients.end());
+				for (WebSocket *ws : closing) {
 					ws->end(1001, "Server shutting down");
 				}
 				clients.clear();
@@ -92,20 +360,418 @@ WebSocketServer::~WebSocketServer()
 	}
 }
 
-void WebSocketServer::broadcast(const std::string &message)
+void WebSocketServer::publish(Topic topic, json value)
 {
 	if (!running || !loop)
 		return;
 
-	auto messageCopy = std::make_shared<std::string>(message);
+	TraceScope trace("WebSocketServer::publish");
 
-	loop->defer([this, messageCopy]() {
-		std::lock_guard<std::mutex> lock(clientsMutex);
-		for (auto *ws : clients) {
-			ws->send(*messageCopy, uWS::OpCode::TEXT);
-		}
+	const std::int64_t timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+						 std::chrono::system_clock::now().time_since_epoch())
+						 .count();
+	const auto publishTime = std::chrono::steady_clock::now();
+	loop->defer([this, topic, timestampMs, publishTime, value = std::move(value)]() mutable {
+		TopicState &state = topicStates[static_cast<std::size_t>(topic)];
+		state.pendingValue = std::move(value);
+		state.pendingTimestampMs = timestampMs;
+		state.pendingPublishTime = publishTime;
+		state.hasPending = true;
+		scheduleFlush();
 	});
 }
 
+std::string WebSocketServer::serialize(Topic topic, Format format, const Event &event)
+{
+	TraceScope trace("WebSocketServer::serialize");
+	if (format == Format::Text) {
+		return event.value.is_string() ? event.value.get_ref<const std::string &>() : event.value.dump();
+	}
+
+	const json envelope = {{"v", SCHEMA_VERSION},
+			       {"topic", getTopicName(topic)},
+			       {"seq", event.sequence},
+			       {"ts", event.timestampMs},
+			       {"data", event.value}};
+	if (format == Format::Json) {
+		return envelope.dump();
+	}
+	const std::vector<std::uint8_t> packed = json::to_msgpack(envelope);
+	return std::string(packed.begin(), packed.end());
+}
+
+const std::string &WebSocketServer::getPayload(Topic topic, Format format)
+{
+	TopicState &state = topicStates[static_cast<std::size_t>(topic)];
+	std::string &payload = state.payloads[static_cast<std::size_t>(format)];
+	if (payload.empty() && !state.history.empty()) {
+		payload = serialize(topic, format, state.history.back());
+	}
+	return payload;
+}
+
+void WebSocketServer::countSent(UserData *userData, std::size_t bytes) noexcept
+{
+	FormatCounters &counters = formatCounters[static_cast<std::size_t>(userData->format)];
+	counters.sentMessages++;
+	counters.sentBytes += bytes;
+	sentMessageCount.fetch_add(1, std::memory_order_relaxed);
+	sentByteCount.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void WebSocketServer::sendHistory(WebSocket *ws, Topic topic, std::uint64_t since)
+{
+	UserData *userData = ws->getUserData();
+	for (const Event &event : topicStates[static_cast<std::size_t>(topic)].history) {
+		if (event.sequence <= since) {
+			continue;
+		}
+		const std::string payload = serialize(topic, userData->format, event);
+		ws->send(payload, getOpCode(userData->format));
+		countSent(userData, payload.size());
+	}
+}
+
+void WebSocketServer::sendLast(WebSocket *ws, Topic topic)
+{
+	UserData *userData = ws->getUserData();
+	const std::string &payload = getPayload(topic, userData->format);
+	if (payload.empty()) {
+		return;
+	}
+
+	ws->send(payload, getOpCode(userData->format));
+	countSent(userData, payload.size());
+}
+
+void WebSocketServer::subscribe(WebSocket *ws, Topic topic)
+{
+	ws->subscribe(getChannelName(topic, ws->getUserData()->format));
+	ws->getUserData()->topics |= toMask(topic);
+	sendLast(ws, topic);
+}
+
+void WebSocketServer::createFlushTimer(uWS::Loop *threadLoop)
+{
+	flushTimer = us_create_timer(reinterpret_cast<us_loop_t *>(threadLoop), 0, sizeof(WebSocketServer *));
+	*static_cast<WebSocketServer **>(us_timer_ext(flushTimer)) = this;
+}
+
+void WebSocketServer::scheduleFlush()
+{
+	if (flushScheduled || !flushTimer) {
+		return;
+	}
+	flushScheduled = true;
+	us_timer_set(
+		flushTimer,
+		[](struct us_timer_t *timer) { (*static_cast<WebSocketServer **>(us_timer_ext(timer)))->flush(); },
+		FLUSH_INTERVAL_MS, 0);
+}
+
+void WebSocketServer::flush()
+{
+	TraceScope trace("WebSocketServer::flush");
+	flushScheduled = false;
+
+	TopicMask published = 0;
+	for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+		const Topic topic = static_cast<Topic>(i);
+		TopicState &state = topicStates[i];
+		if (!state.hasPending) {
+			continue;
+		}
+		state.hasPending = false;
+		if (!state.history.empty() && state.pendingValue == state.history.back().value) {
+			continue;
+		}
+		state.history.push_back(
+			{state.nextSequence++, state.pendingTimestampMs, std::move(state.pendingValue)});
+		if (state.history.size() > HISTORY_CAPACITY) {
+			state.history.pop_front();
+		}
+		for (std::string &payload : state.payloads) {
+			payload.clear();
+		}
+
+		// Only formats with subscribers are serialized, each exactly once.
+		for (std::size_t j = 0; j < FORMAT_COUNT; j++) {
+			const Format format = static_cast<Format>(j);
+			const std::string &channel = getChannelName(topic, format);
+			if (app && app->numSubscribers(channel) > 0) {
+				app->publish(channel, getPayload(topic, format), getOpCode(format));
+			}
+		}
+		published |= toMask(topic);
+
+		const auto publishDelay = std::chrono::steady_clock::now() - state.pendingPublishTime;
+		publishDelayNs.record(static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(publishDelay).count()));
+	}
+
+	sweepClients(published);
+}
+
+void WebSocketServer::sweepClients(TopicMask published)
+{
+	std::vector<WebSocket *> slowClients;
+	std::int64_t bufferedBytes = 0;
+
+	for (WebSocket *ws : clients) {
+		UserData *userData = ws->getUserData();
+		FormatCounters &counters = formatCounters[static_cast<std::size_t>(userData->format)];
+		const unsigned int buffered = ws->getBufferedAmount();
+		userData->bufferedBytes = buffered;
+		bufferedBytes += buffered;
+
+		for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+			const TopicMask mask = toMask(static_cast<Topic>(i));
+			if (!(userData->topics & mask)) {
+				continue;
+			}
+
+			if (published & mask) {
+				const std::size_t size = getPayload(static_cast<Topic>(i), userData->format).size();
+				if (userData->parked & mask) {
+					counters.droppedMessages++;
+					counters.droppedBytes += size;
+					droppedMessageCount.fetch_add(1, std::memory_order_relaxed);
+					droppedByteCount.fetch_add(size, std::memory_order_relaxed);
+					if (config.topics[i].policy == BackpressurePolicy::KeepLatest) {
+						userData->missed |= mask;
+					}
+				} else {
+					countSent(userData, size);
+				}
+			}
+
+			if (!(userData->parked & mask) && buffered > config.topics[i].highWatermarkBytes) {
+				if (config.topics[i].policy == BackpressurePolicy::Disconnect) {
+					slowClients.push_back(ws);
+					break;
+				}
+				ws->unsubscribe(getChannelName(static_cast<Topic>(i), userData->format));
+				userData->parked |= mask;
+			}
+		}
+	}
+
+	MemoryAccounting::instance().set(MemoryAccounting::Category::WebSocketSendBuffers, bufferedBytes);
+
+	// end() runs the close handler, which erases from clients.
+	for (WebSocket *ws : slowClients) {
+		slowClientDisconnectCount.fetch_add(1, std::memory_order_relaxed);
+		ws->end(1008, "Client too slow");
+	}
+}
+
+void WebSocketServer::resumeClient(WebSocket *ws)
+{
+	UserData *userData = ws->getUserData();
+	if (userData->parked == 0) {
+		return;
+	}
+
+	for (std::size_t i = 0; i < TOPIC_COUNT; i++) {
+		const TopicMask mask = toMask(static_cast<Topic>(i));
+		if (!(userData->parked & mask) || ws->getBufferedAmount() > config.topics[i].highWatermarkBytes / 2) {
+			continue;
+		}
+
+		ws->subscribe(getChannelName(static_cast<Topic>(i), userData->format));
+		userData->parked &= ~mask;
+		if (userData->missed & mask) {
+			userData->missed &= ~mask;
+			sendLast(ws, static_cast<Topic>(i));
+		}
+	}
+}
+
+void WebSocketServer::serveAsset(uWS::HttpResponse<false> *res, uWS::HttpRequest *req)
+{
+	const StaticAssets::Asset *asset = config.assets->find(req->getUrl());
+	if (!asset) {
+		res->writeStatus("404 Not Found")->end("Not Found");
+		return;
+	}
+
+	// A cache may hold either representation, so either ETag revalidates it.
+	const std::string_view ifNoneMatch = req->getHeader("if-none-match");
+	const bool identityMatches = matchesEtag(ifNoneMatch, asset->etag);
+	if (identityMatches || matchesEtag(ifNoneMatch, asset->gzipEtag)) {
+		res->writeStatus("304 Not Modified")
+			->writeHeader("ETag", identityMatches ? asset->etag : asset->gzipEtag)
+			->writeHeader("Cache-Control", asset->cacheControl)
+			->writeHeader("Vary", "Accept-Encoding")
+			->end();
+		return;
+	}
+
+	const bool useGzip = !asset->gzipBody.empty() &&
+			     req->getHeader("accept-encoding").find("gzip") != std::string_view::npos;
+	res->writeHeader("Content-Type", asset->contentType)
+		->writeHeader("ETag", useGzip ? asset->gzipEtag : asset->etag)
+		->writeHeader("Cache-Control", asset->cacheControl)
+		->writeHeader("Vary", "Accept-Encoding");
+	if (useGzip) {
+		res->writeHeader("Content-Encoding", "gzip");
+	}
+	res->end(useGzip ? asset->gzipBody : asset->body);
+}
+
+void WebSocketServer::serveMetrics(uWS::HttpResponse<false> *res)
+{
+	TraceScope trace("WebSocketServer::serveMetrics");
+
+	PrometheusText text;
+	text.family("live_unite_websocket_clients", "gauge", "Connected WebSocket clients.");
+	text.sample("live_unite_websocket_clients", {}, static_cast<std::uint64_t>(clients.size()));
+	text.family("live_unite_websocket_sent_messages_total", "counter", "Messages sent to WebSocket clients.");
+	text.sample("live_unite_websocket_sent_messages_total", {}, sentMessageCount.load(std::memory_order_relaxed));
+	text.family("live_unite_websocket_sent_bytes_total", "counter", "Payload bytes sent to WebSocket clients.");
+	text.sample("live_unite_websocket_sent_bytes_total", {}, sentByteCount.load(std::memory_order_relaxed));
+	text.family("live_unite_websocket_dropped_messages_total", "counter",
+		    "Messages not sent to clients parked by backpressure.");
+	text.sample("live_unite_websocket_dropped_messages_total", {},
+		    droppedMessageCount.load(std::memory_order_relaxed));
+	text.family("live_unite_websocket_dropped_bytes_total", "counter",
+		    "Payload bytes not sent to clients parked by backpressure.");
+	text.sample("live_unite_websocket_dropped_bytes_total", {}, droppedByteCount.load(std::memory_order_relaxed));
+	text.family("live_unite_websocket_slow_client_disconnects_total", "counter",
+		    "Clients disconnected for being too slow.");
+	text.sample("live_unite_websocket_slow_client_disconnects_total", {},
+		    slowClientDisconnectCount.load(std::memory_order_relaxed));
+
+	writeFormatMetrics(text);
+
+	text.histogram("live_unite_websocket_publish_delay_seconds",
+		       "Time from publishing a value to handing it to the clients, including coalescing.",
+		       publishDelayNs);
+	text.family("live_unite_websocket_loop_cpu_seconds_total", "counter", "CPU time used by the server thread.");
+	text.sample("live_unite_websocket_loop_cpu_seconds_total", {}, getCurrentThreadCpuSeconds());
+
+	if (config.metricsWriter) {
+		config.metricsWriter(text);
+	}
+
+	res->writeHeader("Content-Type", PrometheusText::CONTENT_TYPE)->end(text.take());
+}
+
+void WebSocketServer::writeFormatMetrics(PrometheusText &text) const
+{
+	struct FormatGauges {
+		std::uint64_t clients = 0;
+		std::uint64_t bufferedBytes = 0;
+		std::uint64_t maxBufferedBytes = 0;
+	};
+	std::array<FormatGauges, FORMAT_COUNT> gauges{};
+	for (WebSocket *ws : clients) {
+		const UserData *userData = ws->getUserData();
+		FormatGauges &formatGauges = gauges[static_cast<std::size_t>(userData->format)];
+		formatGauges.clients++;
+		formatGauges.bufferedBytes += userData->bufferedBytes;
+		formatGauges.maxBufferedBytes = std::max<std::uint64_t>(formatGauges.maxBufferedBytes,
+									 userData->bufferedBytes);
+	}
+
+	const auto writeFamily = [&](const char *name, const char *type, const char *help, auto getValue) {
+		text.family(name, type, help);
+		for (std::size_t i = 0; i < FORMAT_COUNT; i++) {
+			const std::string labels =
+				std::string("format=\"") + getFormatName(static_cast<Format>(i)) + "\"";
+			text.sample(name, labels, getValue(formatCounters[i], gauges[i]));
+		}
+	};
+	writeFamily("live_unite_websocket_format_clients", "gauge", "Connected WebSocket clients by format.",
+		    [](const FormatCounters &, const FormatGauges &formatGauges) { return formatGauges.clients; });
+	writeFamily("live_unite_websocket_format_sent_messages_total", "counter",
+		    "Messages sent to clients by format.",
+		    [](const FormatCounters &counters, const FormatGauges &) { return counters.sentMessages; });
+	writeFamily("live_unite_websocket_format_sent_bytes_total", "counter",
+		    "Payload bytes sent to clients by format.",
+		    [](const FormatCounters &counters, const FormatGauges &) { return counters.sentBytes; });
+	writeFamily("live_unite_websocket_format_dropped_messages_total", "counter",
+		    "Messages not sent to clients parked by backpressure, by format.",
+		    [](const FormatCounters &counters, const FormatGauges &) { return counters.droppedMessages; });
+	writeFamily("live_unite_websocket_format_dropped_bytes_total", "counter",
+		    "Payload bytes not sent to clients parked by backpressure, by format.",
+		    [](const FormatCounters &counters, const FormatGauges &) { return counters.droppedBytes; });
+	writeFamily("live_unite_websocket_format_buffered_bytes", "gauge",
+		    "Bytes waiting in the send buffers of all clients of a format as of the last flush or drain.",
+		    [](const FormatCounters &, const FormatGauges &formatGauges) {
+			    return formatGauges.bufferedBytes;
+		    });
+	writeFamily("live_unite_websocket_format_max_buffered_bytes", "gauge",
+		    "Bytes waiting in the fullest send buffer among the clients of a format.",
+		    [](const FormatCounters &, const FormatGauges &formatGauges) {
+			    return formatGauges.maxBufferedBytes;
+		    });
+}
+
+void WebSocketServer::handleMessage(WebSocket *ws, std::string_view message)
+{
+	const json request = json::parse(message, nullptr, false);
+	if (request.is_discarded() || !request.is_object()) {
+		return;
+	}
+
+	UserData *userData = ws->getUserData();
+	for (const char *action : {"subscribe", "unsubscribe"}) {
+		if (!request.contains(action) || !request[action].is_array()) {
+			continue;
+		}
+		const bool subscribe = std::string_view(action) == "subscribe";
+		for (const json &name : request[action]) {
+			Topic topic;
+			if (!name.is_string() || !parseTopic(name.get<std::string>(), topic)) {
+				continue;
+			}
+			if (subscribe) {
+				if (!(userData->topics & toMask(topic))) {
+					this->subscribe(ws, topic);
+				}
+			} else {
+				ws->unsubscribe(getChannelName(topic, userData->format));
+				userData->topics &= ~toMask(topic);
+				userData->parked &= ~toMask(topic);
+				userData->missed &= ~toMask(topic);
+			}
+		}
+	}
+
+	updateSubscribedTopics();
+
+	if (request.contains("history") && request["history"].is_array()) {
+		// json::value() throws on a mismatched type, and an exception must not escape a uWS handler.
+		const std::uint64_t since = request.contains("since") && request["since"].is_number_unsigned()
+						    ? request["since"].get<std::uint64_t>()
+						    : 0;
+		for (const json &name : request["history"]) {
+			Topic topic;
+			if (name.is_string() && parseTopic(name.get<std::string>(), topic)) {
+				sendHistory(ws, topic, since);
+			}
+		}
+	}
+}
+
+void WebSocketServer::updateSubscribedTopics() noexcept
+{
+	TopicMask topics = 0;
+	for (WebSocket *ws : clients) {
+		topics |= ws->getUserData()->topics;
+	}
+	subscribedTopics.store(topics, std::memory_order_relaxed);
+}
+
+void WebSocketServer::accountSendBuffers() noexcept
+{
+	std::int64_t bufferedBytes = 0;
+	for (auto *ws : clients) {
+		bufferedBytes += ws->getBufferedAmount();
+	}
+	MemoryAccounting::instance().set(MemoryAccounting::Category::WebSocketSendBuffers, bufferedBytes);
+}
+
 } // namespace LiveUniteTools
 } // namespace KaitoTokyo
@@ -18,38 +18,327 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
-#include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
+#include <nlohmann/json.hpp>
 #include <uwebsockets/App.h>
 #include <uwebsockets/Loop.h>
 
+#include "../BridgeUtils/LatencyHistogram.hpp"
+#include "../BridgeUtils/PrometheusText.hpp"
+
+#include "StaticAssets.hpp"
+
 namespace KaitoTokyo {
 namespace LiveUniteTools {
 
+/**
+ * @brief Serves analysis results to browser sources over WebSocket.
+ *
+ * Messages are published to topics and fanned out by uWS to the clients subscribed to each topic.
+ * The server listens on DEFAULT_PORT unless configured otherwise.
+ * A client chooses its topics with a query string such as `ws://localhost:54834/?topics=classifier,timer`
+ * and may change them later by sending `{"subscribe": ["scores"], "unsubscribe": ["timer"]}`.
+ * Clients that do not ask for any topic are subscribed to the classifier topic.
+ *
+ * Each client also picks a format with `format=` in the query string:
+ * - text (the default): string values as-is and other values as JSON, as the original overlays expect.
+ * - json: an envelope `{"v": 1, "topic": ..., "seq": ..., "ts": <Unix ms>, "data": ...}` in a text frame.
+ * - msgpack: the same envelope in MessagePack, in a binary frame.
+ * Every value is serialized at most once per format and the payload is shared by all clients of that format.
+ *
+ * Each topic numbers its values with a sequence number starting at 1 and keeps the last HISTORY_CAPACITY of them.
+ * A client that missed values, e.g. because its browser source reloaded, can send
+ * `{"history": ["timer"], "since": 41}` to receive the retained values of the topic with a sequence number
+ * greater than 41, oldest first.
+ *
+ * When configured with assets, the same port also serves them over HTTP GET, e.g.
+ * `http://localhost:54834/particles.html`, with ETag revalidation and gzip for clients that accept it.
+ * `http://localhost:54834/metrics` always serves the server's counters, the counters and buffered bytes of
+ * every connected client, and those of the configured metrics writer, in the Prometheus text format.
+ *
+ * Messages published to a topic within one flush interval are coalesced into the latest one, and a message
+ * equal to the last one sent on its topic is suppressed. New subscribers receive the last message right away.
+ *
+ * A client whose send buffer grows past a topic's high watermark is handled by the topic's backpressure policy.
+ * With Drop and KeepLatest, the client is taken off the topic until its buffer drains to half the watermark;
+ * KeepLatest then sends it the last message it missed. With Disconnect, the client is closed.
+ * Independently of the policies, uWS closes any client buffering more than maxBackpressureBytes.
+ *
+ * All client bookkeeping happens on the loop thread. publish() may be called from any thread.
+ */
 class WebSocketServer {
 public:
+	enum class Topic : std::size_t {
+		Classifier,
+		Timer,
+		Scores,
+		Stats,
+		Count,
+	};
+
+	static constexpr std::size_t TOPIC_COUNT = static_cast<std::size_t>(Topic::Count);
+
+	using TopicMask = std::uint32_t;
+
+	static constexpr TopicMask toMask(Topic topic) noexcept
+	{
+		return TopicMask{1} << static_cast<std::size_t>(topic);
+	}
+
+	enum class Format : std::size_t {
+		Text,
+		Json,
+		MessagePack,
+		Count,
+	};
+
+	static constexpr std::size_t FORMAT_COUNT = static_cast<std::size_t>(Format::Count);
+
+	/**
+	 * @brief The version of the json and msgpack envelopes, bumped on incompatible changes.
+	 */
+	static constexpr int SCHEMA_VERSION = 1;
+
+	static constexpr std::size_t HISTORY_CAPACITY = 64;
+
+	static constexpr int DEFAULT_PORT = 54834;
+
+	enum class BackpressurePolicy {
+		Drop,
+		KeepLatest,
+		Disconnect,
+	};
+
+	struct TopicConfig {
+		BackpressurePolicy policy;
+		unsigned int highWatermarkBytes;
+	};
+
+	struct Config {
+		std::array<TopicConfig, TOPIC_COUNT> topics = {{
+			{BackpressurePolicy::KeepLatest, 64 * 1024},
+			{BackpressurePolicy::KeepLatest, 64 * 1024},
+			{BackpressurePolicy::Drop, 64 * 1024},
+			{BackpressurePolicy::Drop, 64 * 1024},
+		}};
+		int port = DEFAULT_PORT;
+		unsigned int maxBackpressureBytes = 1024 * 1024;
+		/** The overlay assets to serve over HTTP, or nullptr to serve none. */
+		std::shared_ptr<const StaticAssets> assets;
+		/** Appends metrics of other subsystems to /metrics. Called on the loop thread on every scrape. */
+		std::function<void(BridgeUtils::PrometheusText &)> metricsWriter;
+	};
+
+	/**
+	 * @brief Returns the server shared by all filter instances, creating it with the configured settings.
+	 */
 	static std::shared_ptr<WebSocketServer> getSharedWebSocketServer();
 
-	WebSocketServer();
+	/**
+	 * @brief Sets the configuration used when the shared server is created.
+	 */
+	static void configure(const Config &config);
+
+	/**
+	 * @brief Reads a configuration such as `{"port": 54834, "maxBackpressureKiB": 1024,
+	 * "topics": {"scores": {"policy": "drop", "highWatermarkKiB": 64}}}`.
+	 * A missing file yields the defaults.
+	 * @throws std::runtime_error if the file cannot be parsed.
+	 */
+	static Config loadConfig(const char *path);
+
+	static const char *getTopicName(Topic topic) noexcept;
+
+	/**
+	 * @brief Looks up a topic by name.
+	 * @return Whether the name is a known topic.
+	 */
+	static bool parseTopic(std::string_view name, Topic &topic) noexcept;
+
+	static const char *getFormatName(Format format) noexcept;
+
+	static bool parseFormat(std::string_view name, Format &format) noexcept;
+
+	explicit WebSocketServer(const Config &_config);
 	~WebSocketServer();
 
-	void broadcast(const std::string &message);
+	/**
+	 * @brief Queues a value for the subscribers of a topic, to be serialized and sent on the next flush.
+	 */
+	void publish(Topic topic, nlohmann::json value);
+
+	std::uint64_t getDroppedMessageCount() const noexcept
+	{
+		return droppedMessageCount.load(std::memory_order_relaxed);
+	}
+
+	std::uint64_t getSlowClientDisconnectCount() const noexcept
+	{
+		return slowClientDisconnectCount.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Whether any client or internal consumer currently wants a topic. May be called from any thread.
+	 */
+	bool hasConsumers(Topic topic) const noexcept
+	{
+		return (subscribedTopics.load(std::memory_order_relaxed) & toMask(topic)) ||
+		       internalConsumerCounts[static_cast<std::size_t>(topic)].load(std::memory_order_relaxed) > 0;
+	}
+
+	/**
+	 * @brief Registers an in-process consumer of a topic, which keeps its analyzer running without clients.
+	 */
+	void addInternalConsumer(Topic topic) noexcept
+	{
+		internalConsumerCounts[static_cast<std::size_t>(topic)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void removeInternalConsumer(Topic topic) noexcept
+	{
+		internalConsumerCounts[static_cast<std::size_t>(topic)].fetch_sub(1, std::memory_order_relaxed);
+	}
 
 private:
-	struct UserData {};
+	struct UserData {
+		Format format = Format::Text;
+		/** The topics the client asked for. */
+		TopicMask topics = 0;
+		/** The topics the client is taken off because of backpressure. */
+		TopicMask parked = 0;
+		/** The parked KeepLatest topics that were published while parked. */
+		TopicMask missed = 0;
+		/** The send buffer as of the last sweep or drain. */
+		unsigned int bufferedBytes = 0;
+	};
+
+	using WebSocket = uWS::WebSocket<false, true, UserData>;
+
+	/** The traffic of every client that used one format, connected or not. Touched on the loop thread only. */
+	struct FormatCounters {
+		std::uint64_t sentMessages = 0;
+		std::uint64_t sentBytes = 0;
+		std::uint64_t droppedMessages = 0;
+		std::uint64_t droppedBytes = 0;
+	};
+
+	struct Event {
+		std::uint64_t sequence;
+		std::int64_t timestampMs;
+		nlohmann::json value;
+	};
+
+	struct TopicState {
+		/** The retained values, the last one at the back. */
+		std::deque<Event> history;
+		std::uint64_t nextSequence = 1;
+		nlohmann::json pendingValue;
+		std::int64_t pendingTimestampMs = 0;
+		std::chrono::steady_clock::time_point pendingPublishTime;
+		bool hasPending = false;
+		/** The last value serialized per format, filled on first use. */
+		std::array<std::string, FORMAT_COUNT> payloads;
+	};
+
+	/**
+	 * @brief About one output frame at 60 fps.
+	 */
+	static constexpr int FLUSH_INTERVAL_MS = 16;
+
+	static constexpr uWS::OpCode getOpCode(Format format) noexcept
+	{
+		return format == Format::MessagePack ? uWS::OpCode::BINARY : uWS::OpCode::TEXT;
+	}
+
+	/**
+	 * @brief Publishes the bytes queued for slow clients to MemoryAccounting.
+	 * Must be called on the loop thread.
+	 */
+	void accountSendBuffers() noexcept;
+
+	/**
+	 * @brief Recomputes subscribedTopics from the clients. Must be called on the loop thread.
+	 */
+	void updateSubscribedTopics() noexcept;
+
+	/**
+	 * @brief Updates the client counters for the topics just published and applies the backpressure policies.
+	 */
+	void sweepClients(TopicMask published);
+
+	/**
+	 * @brief Puts parked topics back once the client's buffer has drained.
+	 */
+	void resumeClient(WebSocket *ws);
+
+	/**
+	 * @brief Gets the uWS topic that carries a topic in a format.
+	 */
+	static const std::string &getChannelName(Topic topic, Format format);
+
+	static std::string serialize(Topic topic, Format format, const Event &event);
+
+	/**
+	 * @brief Gets the last value of a topic serialized in a format, serializing it on first use.
+	 */
+	const std::string &getPayload(Topic topic, Format format);
+
+	/**
+	 * @brief Sends the last value of a topic to one client.
+	 */
+	void sendLast(WebSocket *ws, Topic topic);
+
+	/**
+	 * @brief Counts a message sent to a client, both for its format and in the server totals.
+	 */
+	void countSent(UserData *userData, std::size_t bytes) noexcept;
+
+	void sendHistory(WebSocket *ws, Topic topic, std::uint64_t since);
+	void serveAsset(uWS::HttpResponse<false> *res, uWS::HttpRequest *req);
+	void serveMetrics(uWS::HttpResponse<false> *res);
+	void writeFormatMetrics(BridgeUtils::PrometheusText &text) const;
+	void handleMessage(WebSocket *ws, std::string_view message);
+	void subscribe(WebSocket *ws, Topic topic);
+	void createFlushTimer(uWS::Loop *threadLoop);
+	void scheduleFlush();
+	void flush();
+
+	const Config config;
 
 	uWS::Loop *loop = nullptr;
+	uWS::App *app = nullptr;
 	struct us_listen_socket_t *listenSocket = nullptr;
 
-	std::unordered_set<uWS::WebSocket<false, true, UserData> *> clients;
-	std::mutex clientsMutex;
+	std::unordered_set<WebSocket *> clients;
+	std::array<TopicState, TOPIC_COUNT> topicStates;
+	struct us_timer_t *flushTimer = nullptr;
+	bool flushScheduled = false;
 	std::thread serverThread;
 	std::atomic<bool> running;
+
+	std::atomic<TopicMask> subscribedTopics = 0;
+	std::array<std::atomic<int>, TOPIC_COUNT> internalConsumerCounts{};
+	/** From publish() to handing the value to uWS, including coalescing. Recorded on the loop thread. */
+	BridgeUtils::LatencyHistogram publishDelayNs;
+	std::array<FormatCounters, FORMAT_COUNT> formatCounters{};
+	std::atomic<std::uint64_t> sentMessageCount = 0;
+	std::atomic<std::uint64_t> sentByteCount = 0;
+	std::atomic<std::uint64_t> droppedMessageCount = 0;
+	std::atomic<std::uint64_t> droppedByteCount = 0;
+	std::atomic<std::uint64_t> slowClientDisconnectCount = 0;
 };
 
 } // namespace LiveUniteTools
@@ -0,0 +1,265 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <queue>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "BridgeUtils/ILogger.hpp"
+#include "BridgeUtils/LatencyHistogram.hpp"
+#include "BridgeUtils/ThrottledTaskQueue.hpp"
+
+using namespace KaitoTokyo::BridgeUtils;
+
+namespace {
+
+// Counts the allocations made by the calling thread while counting is on.
+thread_local bool countingAllocations = false;
+thread_local std::size_t allocationCount = 0;
+
+class AllocationCounter {
+public:
+	AllocationCounter() noexcept
+	{
+		allocationCount = 0;
+		countingAllocations = true;
+	}
+	~AllocationCounter() noexcept { countingAllocations = false; }
+	std::size_t get() const noexcept { return allocationCount; }
+};
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+	if (countingAllocations) {
+		allocationCount++;
+	}
+	if (void *p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+// GCC cannot tell that the replaced operator new pairs with these deletes.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace {
+
+constexpr int ITERATIONS = 200000;
+constexpr int WARMUP_ITERATIONS = 1000;
+
+class NullLogger : public ILogger {
+protected:
+	void log(LogLevel, std::string_view) const noexcept override {}
+	const char *getPrefix() const noexcept override { return ""; }
+};
+
+/**
+ * @brief The queue as it was before tasks moved into fixed slots: a deque of std::function wrappers and a
+ * shared_ptr token per push. Kept here as the baseline of the benchmark.
+ */
+class LegacyTaskQueue {
+public:
+	using CancellationToken = std::shared_ptr<std::atomic<bool>>;
+	using CancellableTask = std::function<void(const CancellationToken &)>;
+
+private:
+	using QueuedTask = std::pair<std::function<void()>, CancellationToken>;
+
+	const std::size_t maxQueueSize;
+	std::mutex mtx;
+	std::condition_variable cond;
+	std::queue<QueuedTask> queue;
+	bool stopped = false;
+	std::thread worker;
+
+public:
+	explicit LegacyTaskQueue(std::size_t _maxQueueSize)
+		: maxQueueSize(_maxQueueSize),
+		  worker(&LegacyTaskQueue::workerLoop, this)
+	{
+	}
+
+	~LegacyTaskQueue()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopped = true;
+			while (!queue.empty()) {
+				queue.front().second->store(true);
+				queue.pop();
+			}
+		}
+		cond.notify_all();
+		worker.join();
+	}
+
+	CancellationToken push(CancellableTask userTask)
+	{
+		auto token = std::make_shared<std::atomic<bool>>(false);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			while (queue.size() >= maxQueueSize) {
+				queue.front().second->store(true);
+				queue.pop();
+			}
+			queue.push({[userTask, token] { userTask(token); }, token});
+		}
+		cond.notify_one();
+		return token;
+	}
+
+private:
+	void workerLoop()
+	{
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cond.wait(lock, [this] { return !queue.empty() || stopped; });
+				if (stopped && queue.empty()) {
+					return;
+				}
+				task = std::move(queue.front().first);
+				queue.pop();
+			}
+			task();
+		}
+	}
+};
+
+struct BenchmarkResult {
+	LatencyHistogram::Snapshot pushNs;
+	double pushesPerSecond;
+	std::size_t allocations;
+};
+
+/**
+ * @brief Times every call of push(i) after a warm-up, counting the allocations of the pushing thread.
+ */
+template<typename Push> BenchmarkResult runBenchmark(Push push)
+{
+	for (int i = 0; i < WARMUP_ITERATIONS; i++) {
+		push(i);
+	}
+
+	LatencyHistogram histogram;
+	AllocationCounter allocationCounter;
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		const auto pushStart = std::chrono::steady_clock::now();
+		push(i);
+		histogram.record(static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pushStart)
+				.count()));
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return {histogram.snapshot(), ITERATIONS / elapsed.count(), allocationCounter.get()};
+}
+
+void report(const char *name, const BenchmarkResult &result)
+{
+	std::printf("%-28s p50 %6llu ns  p99 %6llu ns  %8.2f Mpush/s  %zu allocations\n", name,
+		    static_cast<unsigned long long>(result.pushNs.p50Ns),
+		    static_cast<unsigned long long>(result.pushNs.p99Ns), result.pushesPerSecond / 1e6,
+		    result.allocations);
+}
+
+} // namespace
+
+TEST(ThrottledTaskQueueBenchmark, Push)
+{
+	NullLogger logger;
+	ThrottledTaskQueue queue(logger, 4);
+	std::atomic<int> sink = 0;
+
+	const BenchmarkResult result = runBenchmark([&](int i) {
+		queue.push([&sink, i](const ThrottledTaskQueue::CancellationToken &) { sink += i; });
+	});
+	report("ThrottledTaskQueue push", result);
+	EXPECT_EQ(result.allocations, 0u);
+}
+
+TEST(ThrottledTaskQueueBenchmark, PushReplacingKey)
+{
+	NullLogger logger;
+	ThrottledTaskQueue queue(logger, 4);
+	std::atomic<int> sink = 0;
+
+	const BenchmarkResult result = runBenchmark([&](int i) {
+		queue.push("replace", [&sink, i](const ThrottledTaskQueue::CancellationToken &) { sink += i; });
+	});
+	report("ThrottledTaskQueue replace", result);
+	EXPECT_EQ(result.allocations, 0u);
+}
+
+TEST(ThrottledTaskQueueBenchmark, PushPastDeadline)
+{
+	NullLogger logger;
+	ThrottledTaskQueue queue(logger, 4);
+	std::atomic<int> sink = 0;
+
+	// Every task is already expired, so workers drop them on dequeue.
+	const ThrottledTaskQueue::TaskTiming timing{ThrottledTaskQueue::Clock::now(),
+						    ThrottledTaskQueue::Clock::now() - std::chrono::seconds(1)};
+	const BenchmarkResult result = runBenchmark([&](int i) {
+		queue.push("deadline", timing,
+			   [&sink, i](const ThrottledTaskQueue::CancellationToken &) { sink += i; });
+	});
+	report("ThrottledTaskQueue deadline", result);
+	EXPECT_EQ(result.allocations, 0u);
+	EXPECT_EQ(sink.load(), 0);
+}
+
+TEST(ThrottledTaskQueueBenchmark, LegacyPush)
+{
+	LegacyTaskQueue queue(4);
+	std::atomic<int> sink = 0;
+
+	const BenchmarkResult result = runBenchmark([&](int i) {
+		queue.push([&sink, i](const LegacyTaskQueue::CancellationToken &) { sink += i; });
+	});
+	report("legacy push", result);
+	EXPECT_GT(result.allocations, 0u);
+}
@@ -0,0 +1,108 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "Core/ChangeMap.hpp"
+
+using namespace KaitoTokyo::LiveUniteTools;
+
+namespace {
+
+using ChangeMapData = std::array<std::uint8_t, ChangeMap::TILES_X * ChangeMap::TILES_Y>;
+
+constexpr std::uint32_t SOURCE_WIDTH = 1920;
+constexpr std::uint32_t SOURCE_HEIGHT = 1080;
+constexpr AnalysisScheduler::AnalyzerId ANALYZER = 0;
+constexpr AnalysisScheduler::AnalyzerMask ANALYZER_MASK = AnalysisScheduler::toMask(ANALYZER);
+
+/**
+ * @brief Makes a change map in which only the top-left tile differs.
+ */
+ChangeMapData makeData(std::uint8_t topLeftDifference)
+{
+	ChangeMapData data{};
+	data[0] = topLeftDifference;
+	return data;
+}
+
+struct ChangeMapTest : testing::Test {
+	ChangeMap changeMap{SOURCE_WIDTH, SOURCE_HEIGHT, std::chrono::seconds(1)};
+	ChangeMap::Clock::time_point now = ChangeMap::Clock::now();
+
+	void SetUp() override
+	{
+		changeMap.watch(ANALYZER, 0, 0, 60, 60, 5);
+		// A new watch is dirty, so take it once to start clean.
+		ASSERT_EQ(changeMap.takeChanged(ANALYZER_MASK, now), ANALYZER_MASK);
+	}
+
+	void update(std::uint8_t topLeftDifference)
+	{
+		const ChangeMapData data = makeData(topLeftDifference);
+		changeMap.update(data.data(), ChangeMap::TILES_X, 5);
+	}
+};
+
+} // namespace
+
+TEST_F(ChangeMapTest, SkipsUnchangedRegion)
+{
+	update(0);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(100)), 0u);
+}
+
+TEST_F(ChangeMapTest, RunsOnChangeAboveThreshold)
+{
+	update(6);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(100)), ANALYZER_MASK);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(200)), 0u);
+}
+
+TEST_F(ChangeMapTest, AccumulatesSlowChanges)
+{
+	// A fade that stays under the threshold on every tick still adds up to a change.
+	update(2);
+	update(2);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(100)), 0u);
+	update(2);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(200)), ANALYZER_MASK);
+}
+
+TEST_F(ChangeMapTest, RunsAfterMaxSkipInterval)
+{
+	update(1);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(999)), 0u);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::seconds(1)), ANALYZER_MASK);
+	// Running clears what was accumulated and restarts the interval.
+	update(1);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(1500)), 0u);
+}
+
+TEST_F(ChangeMapTest, IgnoresChangesOutsideRegion)
+{
+	ChangeMapData data{};
+	data[ChangeMap::TILES_X * ChangeMap::TILES_Y - 1] = 255;
+	changeMap.update(data.data(), ChangeMap::TILES_X, 5);
+	EXPECT_EQ(changeMap.takeChanged(ANALYZER_MASK, now + std::chrono::milliseconds(100)), 0u);
+	EXPECT_EQ(changeMap.getChangedTileCount(), 1u);
+}
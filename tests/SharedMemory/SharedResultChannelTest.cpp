@@ -0,0 +1,159 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+
+#include "SharedMemory/SharedResultChannel.hpp"
+
+using namespace KaitoTokyo::LiveUniteTools;
+
+// The channel is a process-wide singleton, so every test leaves it released.
+
+namespace {
+
+struct ReaderResult {
+	int exitStatus = -1;
+	std::string output;
+};
+
+/**
+ * @brief Runs live_unite_results_reader --once in a child process and collects its standard output.
+ */
+ReaderResult runReaderOnce()
+{
+	ReaderResult result;
+	FILE *pipe = popen("\"" LIVE_UNITE_RESULTS_READER "\" --once 2>/dev/null", "r");
+	if (!pipe) {
+		return result;
+	}
+	char buffer[256];
+	std::size_t length;
+	while ((length = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+		result.output.append(buffer, length);
+	}
+	const int status = pclose(pipe);
+	if (status != -1 && WIFEXITED(status)) {
+		result.exitStatus = WEXITSTATUS(status);
+	}
+	return result;
+}
+
+} // namespace
+
+TEST(SharedResultChannel, ReaderSeesWrittenValues)
+{
+	SharedResultChannel &channel = SharedResultChannel::instance();
+	ASSERT_TRUE(channel.acquire());
+
+	lur_results *results = lur_results_open();
+	ASSERT_NE(results, nullptr);
+	EXPECT_TRUE(lur_results_writer_alive(results));
+
+	lur_timer_value timer;
+	EXPECT_EQ(lur_results_read(results, LUR_RECORD_TIMER, &timer, sizeof(timer)), 0);
+
+	channel.writeTimer("12:34");
+	channel.writeClassifier(2, "battle");
+	channel.writeScores({0.25f, 0.75f});
+
+	EXPECT_GT(lur_results_read(results, LUR_RECORD_TIMER, &timer, sizeof(timer)), 0);
+	EXPECT_STREQ(timer.text, "12:34");
+
+	lur_classifier_value classifier;
+	EXPECT_GT(lur_results_read(results, LUR_RECORD_CLASSIFIER, &classifier, sizeof(classifier)), 0);
+	EXPECT_EQ(classifier.class_index, 2);
+	EXPECT_STREQ(classifier.class_name, "battle");
+
+	lur_scores_value scores;
+	EXPECT_GT(lur_results_read(results, LUR_RECORD_SCORES, &scores, sizeof(scores)), 0);
+	ASSERT_EQ(scores.count, 2u);
+	EXPECT_FLOAT_EQ(scores.scores[1], 0.75f);
+	EXPECT_GT(lur_results_read_timestamp(results, LUR_RECORD_SCORES), 0);
+
+	lur_results_close(results);
+	channel.release();
+}
+
+TEST(SharedResultChannel, StaysWhileAnyUserHoldsIt)
+{
+	SharedResultChannel &channel = SharedResultChannel::instance();
+	ASSERT_TRUE(channel.acquire());
+	ASSERT_TRUE(channel.acquire());
+
+	lur_results *results = lur_results_open();
+	ASSERT_NE(results, nullptr);
+
+	// One filter turning the channel off must not pull it from under the other.
+	channel.release();
+	EXPECT_TRUE(channel.isEnabled());
+	EXPECT_TRUE(lur_results_writer_alive(results));
+	lur_results *reopened = lur_results_open();
+	EXPECT_NE(reopened, nullptr);
+	lur_results_close(reopened);
+
+	channel.writeTimer("00:01");
+	lur_timer_value timer;
+	EXPECT_GT(lur_results_read(results, LUR_RECORD_TIMER, &timer, sizeof(timer)), 0);
+	EXPECT_STREQ(timer.text, "00:01");
+
+	channel.release();
+	EXPECT_FALSE(channel.isEnabled());
+	EXPECT_FALSE(lur_results_writer_alive(results));
+	EXPECT_EQ(lur_results_open(), nullptr);
+
+	lur_results_close(results);
+}
+
+TEST(SharedResultChannel, ExtraReleaseIsIgnored)
+{
+	SharedResultChannel &channel = SharedResultChannel::instance();
+	channel.release();
+	ASSERT_TRUE(channel.acquire());
+	EXPECT_TRUE(channel.isEnabled());
+	channel.release();
+	EXPECT_FALSE(channel.isEnabled());
+}
+
+TEST(SharedResultChannel, ReaderProcessSeesWrittenValues)
+{
+	SharedResultChannel &channel = SharedResultChannel::instance();
+	ASSERT_TRUE(channel.acquire());
+	channel.writeTimer("05:43");
+	channel.writeClassifier(1, "lobby");
+
+	const ReaderResult result = runReaderOnce();
+	channel.release();
+
+	EXPECT_EQ(result.exitStatus, 0);
+	EXPECT_NE(result.output.find("timer 05:43\n"), std::string::npos) << result.output;
+	EXPECT_NE(result.output.find("classifier 1 lobby\n"), std::string::npos) << result.output;
+}
+
+TEST(SharedResultChannel, ReaderProcessFailsWithoutWriter)
+{
+	const ReaderResult result = runReaderOnce();
+	EXPECT_EQ(result.exitStatus, 1);
+	EXPECT_TRUE(result.output.empty()) << result.output;
+}
@@ -0,0 +1,104 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A standalone reader of the shared-memory result channel, built as plain C99 against live_unite_results.h
+ * alone. It prints every new classifier, timer and scores value, and waits for the plugin to publish again
+ * when the region is closed.
+ *
+ *     live_unite_results_reader [--once]
+ *
+ * With --once it prints the current values and exits, with status 1 if the plugin is not publishing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "SharedMemory/live_unite_results.h"
+
+static void sleep_ms(long ms)
+{
+	struct timespec duration = {ms / 1000, (ms % 1000) * 1000000L};
+	nanosleep(&duration, NULL);
+}
+
+/* Prints the records whose sequence changed since the last call. */
+static void print_changes(const struct lur_results *results, int64_t *last_sequences)
+{
+	struct lur_classifier_value classifier;
+	const int64_t classifier_sequence =
+		lur_results_read(results, LUR_RECORD_CLASSIFIER, &classifier, sizeof(classifier));
+	if (classifier_sequence > 0 && classifier_sequence != last_sequences[LUR_RECORD_CLASSIFIER]) {
+		last_sequences[LUR_RECORD_CLASSIFIER] = classifier_sequence;
+		classifier.class_name[LUR_TEXT_SIZE - 1] = '\0';
+		printf("classifier %d %s\n", (int)classifier.class_index, classifier.class_name);
+	}
+
+	struct lur_timer_value timer;
+	const int64_t timer_sequence = lur_results_read(results, LUR_RECORD_TIMER, &timer, sizeof(timer));
+	if (timer_sequence > 0 && timer_sequence != last_sequences[LUR_RECORD_TIMER]) {
+		last_sequences[LUR_RECORD_TIMER] = timer_sequence;
+		timer.text[LUR_TEXT_SIZE - 1] = '\0';
+		printf("timer %s\n", timer.text);
+	}
+
+	struct lur_scores_value scores;
+	const int64_t scores_sequence = lur_results_read(results, LUR_RECORD_SCORES, &scores, sizeof(scores));
+	if (scores_sequence > 0 && scores_sequence != last_sequences[LUR_RECORD_SCORES]) {
+		last_sequences[LUR_RECORD_SCORES] = scores_sequence;
+		printf("scores");
+		for (uint32_t i = 0; i < scores.count && i < LUR_MAX_CLASSES; i++)
+			printf(" %.3f", scores.scores[i]);
+		printf("\n");
+	}
+
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const int once = argc > 1 && strcmp(argv[1], "--once") == 0;
+
+	for (;;) {
+		struct lur_results *results = lur_results_open();
+		if (!results) {
+			if (once) {
+				fprintf(stderr, "The plugin is not publishing results\n");
+				return 1;
+			}
+			sleep_ms(1000);
+			continue;
+		}
+
+		int64_t last_sequences[LUR_RECORD_COUNT] = {0};
+		print_changes(results, last_sequences);
+		while (!once && lur_results_writer_alive(results)) {
+			sleep_ms(50);
+			print_changes(results, last_sequences);
+		}
+		lur_results_close(results);
+
+		if (once)
+			return 0;
+		printf("closed\n");
+		fflush(stdout);
+	}
+}
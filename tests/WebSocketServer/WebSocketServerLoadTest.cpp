@@ -0,0 +1,503 @@
+/*
+Live Unite Tools
+Copyright (C) 2025 Kaito Udagawa umireon@kaito.tokyo
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * An in-process load test of WebSocketServer. It starts the server on a local port, connects fast clients
+ * on a uSockets loop of their own and slow clients that read through a small receive buffer at a fixed
+ * byte rate, publishes at a fixed rate and reports delivery latency, throughput, send buffer and RSS growth,
+ * and the CPU time of the server loop from /metrics.
+ *
+ * The load is configured by environment variables:
+ *   LOAD_TEST_PORT (default 54835), LOAD_TEST_FAST_CLIENTS (32), LOAD_TEST_SLOW_CLIENTS (4),
+ *   LOAD_TEST_RATE_HZ (200), LOAD_TEST_SECONDS (2), LOAD_TEST_PAYLOAD_BYTES (1024),
+ *   LOAD_TEST_SLOW_READ_BYTES_PER_SECOND (16384).
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+#include <uwebsockets/App.h>
+#include <uwebsockets/Loop.h>
+
+#include "BridgeUtils/LatencyHistogram.hpp"
+#include "BridgeUtils/MemoryAccounting.hpp"
+#include "WebSocketServer/WebSocketServer.hpp"
+
+using namespace KaitoTokyo::BridgeUtils;
+using namespace KaitoTokyo::LiveUniteTools;
+using json = nlohmann::json;
+
+namespace {
+
+constexpr std::string_view UPGRADE_REQUEST = "GET /?topics=scores&format=text HTTP/1.1\r\n"
+					     "Host: 127.0.0.1\r\n"
+					     "Upgrade: websocket\r\n"
+					     "Connection: Upgrade\r\n"
+					     "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+					     "Sec-WebSocket-Version: 13\r\n"
+					     "\r\n";
+
+constexpr unsigned int TEXT_OPCODE = 1;
+
+std::int64_t getEnvironment(const char *name, std::int64_t defaultValue)
+{
+	const char *value = std::getenv(name);
+	return value ? std::strtoll(value, nullptr, 10) : defaultValue;
+}
+
+struct LoadTestConfig {
+	int port = static_cast<int>(getEnvironment("LOAD_TEST_PORT", WebSocketServer::DEFAULT_PORT + 1));
+	int fastClients = static_cast<int>(getEnvironment("LOAD_TEST_FAST_CLIENTS", 32));
+	int slowClients = static_cast<int>(getEnvironment("LOAD_TEST_SLOW_CLIENTS", 4));
+	double rateHz = static_cast<double>(getEnvironment("LOAD_TEST_RATE_HZ", 200));
+	double seconds = static_cast<double>(getEnvironment("LOAD_TEST_SECONDS", 2));
+	std::size_t payloadBytes = static_cast<std::size_t>(getEnvironment("LOAD_TEST_PAYLOAD_BYTES", 1024));
+	std::size_t slowReadBytesPerSecond =
+		static_cast<std::size_t>(getEnvironment("LOAD_TEST_SLOW_READ_BYTES_PER_SECOND", 16384));
+};
+
+std::uint64_t getNowNs() noexcept
+{
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+						  std::chrono::steady_clock::now().time_since_epoch())
+						  .count());
+}
+
+/**
+ * @brief The peak resident set size of the process in bytes.
+ */
+std::int64_t getMaxRssBytes() noexcept
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return static_cast<std::int64_t>(usage.ru_maxrss);
+#else
+	return static_cast<std::int64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/**
+ * @brief Counts the messages a group of clients received and how long they took from publish().
+ */
+struct DeliveryStats {
+	LatencyHistogram latencyNs;
+	std::atomic<std::uint64_t> messages = 0;
+	std::atomic<std::uint64_t> bytes = 0;
+	std::atomic<std::uint64_t> disconnects = 0;
+
+	void record(std::string_view payload) noexcept
+	{
+		messages.fetch_add(1, std::memory_order_relaxed);
+		bytes.fetch_add(payload.size(), std::memory_order_relaxed);
+
+		// The text format sends the published object as-is, e.g. {"pad":"...","sentNs":123}.
+		constexpr std::string_view key = "\"sentNs\":";
+		const std::size_t position = payload.find(key);
+		if (position == std::string_view::npos) {
+			return;
+		}
+		std::uint64_t sentNs = 0;
+		for (std::size_t i = position + key.size(); i < payload.size(); i++) {
+			if (payload[i] < '0' || payload[i] > '9') {
+				break;
+			}
+			sentNs = sentNs * 10 + static_cast<std::uint64_t>(payload[i] - '0');
+		}
+		latencyNs.record(getNowNs() - sentNs);
+	}
+};
+
+/**
+ * @brief Splits the byte stream of a client into server frames, after skipping the HTTP upgrade response.
+ * Server frames are never masked, and uWS does not fragment the messages it sends.
+ */
+class FrameReader {
+private:
+	std::string buffer;
+	bool upgraded = false;
+
+public:
+	template<typename OnMessage> void feed(const char *data, std::size_t length, OnMessage onMessage)
+	{
+		buffer.append(data, length);
+
+		std::size_t offset = 0;
+		if (!upgraded) {
+			const std::size_t headerEnd = buffer.find("\r\n\r\n");
+			if (headerEnd == std::string::npos) {
+				return;
+			}
+			upgraded = true;
+			offset = headerEnd + 4;
+		}
+
+		while (buffer.size() - offset >= 2) {
+			const auto *bytes = reinterpret_cast<const unsigned char *>(buffer.data() + offset);
+			const std::size_t available = buffer.size() - offset;
+			std::uint64_t payloadLength = bytes[1] & 0x7fu;
+			std::size_t headerLength = 2;
+			if (payloadLength == 126) {
+				headerLength = 4;
+			} else if (payloadLength == 127) {
+				headerLength = 10;
+			}
+			if (available < headerLength) {
+				break;
+			}
+			if (headerLength > 2) {
+				payloadLength = 0;
+				for (std::size_t i = 2; i < headerLength; i++) {
+					payloadLength = (payloadLength << 8) | bytes[i];
+				}
+			}
+			if (available - headerLength < payloadLength) {
+				break;
+			}
+			onMessage(bytes[0] & 0x0fu, std::string_view(buffer.data() + offset + headerLength,
+								     static_cast<std::size_t>(payloadLength)));
+			offset += headerLength + static_cast<std::size_t>(payloadLength);
+		}
+		buffer.erase(0, offset);
+	}
+};
+
+int connectTcp(int port, int receiveBufferBytes)
+{
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (receiveBufferBytes > 0) {
+		// Set before connecting so that the TCP window is negotiated small.
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferBytes, sizeof(receiveBufferBytes));
+	}
+	timeval timeout{0, 100'000};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<std::uint16_t>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool sendAll(int fd, std::string_view data)
+{
+	while (!data.empty()) {
+		const ssize_t written = send(fd, data.data(), data.size(), 0);
+		if (written <= 0) {
+			return false;
+		}
+		data.remove_prefix(static_cast<std::size_t>(written));
+	}
+	return true;
+}
+
+/**
+ * @brief Waits for the server thread to start listening.
+ */
+bool waitForServer(int port)
+{
+	for (int attempt = 0; attempt < 100; attempt++) {
+		const int fd = connectTcp(port, 0);
+		if (fd >= 0) {
+			close(fd);
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+/**
+ * @brief Reads the server loop's CPU time from /metrics.
+ */
+double scrapeLoopCpuSeconds(int port)
+{
+	const int fd = connectTcp(port, 0);
+	if (fd < 0) {
+		return 0.0;
+	}
+	sendAll(fd, "GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+
+	std::string response;
+	char chunk[4096];
+	for (ssize_t received; (received = recv(fd, chunk, sizeof(chunk), 0)) > 0;) {
+		response.append(chunk, static_cast<std::size_t>(received));
+	}
+	close(fd);
+
+	constexpr std::string_view name = "\nlive_unite_websocket_loop_cpu_seconds_total ";
+	const std::size_t position = response.find(name);
+	return position == std::string::npos ? 0.0 : std::strtod(response.c_str() + position + name.size(), nullptr);
+}
+
+/**
+ * @brief Clients that read as fast as they can, on a uSockets loop of their own like the server's.
+ * Every socket is touched on the loop thread only.
+ */
+class FastClients {
+private:
+	DeliveryStats &stats;
+	std::vector<FrameReader> readers;
+	std::unordered_set<us_socket_t *> sockets;
+	uWS::Loop *loop = nullptr;
+	std::thread thread;
+
+	static FastClients *getSelf(us_socket_t *s)
+	{
+		return *static_cast<FastClients **>(us_socket_context_ext(0, us_socket_context(0, s)));
+	}
+
+public:
+	FastClients(int port, int count, DeliveryStats &_stats) : stats(_stats), readers(count)
+	{
+		std::promise<uWS::Loop *> loopPromise;
+		auto loopFuture = loopPromise.get_future();
+
+		thread = std::thread([this, port, count, p = std::move(loopPromise)]() mutable {
+			uWS::Loop *threadLoop = uWS::Loop::get();
+
+			us_socket_context_options_t options{};
+			us_socket_context_t *context = us_create_socket_context(
+				0, reinterpret_cast<us_loop_t *>(threadLoop), sizeof(FastClients *), options);
+			*static_cast<FastClients **>(us_socket_context_ext(0, context)) = this;
+
+			us_socket_context_on_open(0, context, [](us_socket_t *s, int, char *, int) {
+				const int length = static_cast<int>(UPGRADE_REQUEST.size());
+				us_socket_write(0, s, UPGRADE_REQUEST.data(), length, 0);
+				return s;
+			});
+			us_socket_context_on_data(0, context, [](us_socket_t *s, char *data, int length) {
+				FastClients *self = getSelf(s);
+				FrameReader *reader = *static_cast<FrameReader **>(us_socket_ext(0, s));
+				reader->feed(data, static_cast<std::size_t>(length),
+					     [self](unsigned int opCode, std::string_view payload) {
+						     if (opCode == TEXT_OPCODE) {
+							     self->stats.record(payload);
+						     }
+					     });
+				return s;
+			});
+			us_socket_context_on_writable(0, context, [](us_socket_t *s) { return s; });
+			us_socket_context_on_timeout(0, context, [](us_socket_t *s) { return s; });
+			us_socket_context_on_end(0, context,
+						 [](us_socket_t *s) { return us_socket_close(0, s, 0, nullptr); });
+			us_socket_context_on_close(0, context, [](us_socket_t *s, int, void *) {
+				FastClients *self = getSelf(s);
+				if (self->sockets.erase(s)) {
+					self->stats.disconnects.fetch_add(1, std::memory_order_relaxed);
+				}
+				return s;
+			});
+			us_socket_context_on_connect_error(0, context, [](us_socket_t *s, int) { return s; });
+
+			for (int i = 0; i < count; i++) {
+				us_socket_t *s = us_socket_context_connect(0, context, "127.0.0.1", port, nullptr, 0,
+									   sizeof(FrameReader *));
+				if (s) {
+					*static_cast<FrameReader **>(us_socket_ext(0, s)) = &readers[i];
+					sockets.insert(s);
+				}
+			}
+
+			p.set_value(threadLoop);
+			threadLoop->run();
+			us_socket_context_free(0, context);
+		});
+
+		loop = loopFuture.get();
+	}
+
+	~FastClients()
+	{
+		loop->defer([this]() {
+			// Closing by ourselves is not a disconnect, so forget the sockets before closing them.
+			const std::unordered_set<us_socket_t *> closing = std::move(sockets);
+			sockets.clear();
+			for (us_socket_t *s : closing) {
+				us_socket_close(0, s, 0, nullptr);
+			}
+		});
+		thread.join();
+	}
+};
+
+/**
+ * @brief A client that reads a fixed number of bytes per second through a small receive buffer, so that the
+ * server's send buffer for it fills up.
+ */
+class SlowClient {
+private:
+	DeliveryStats &stats;
+	FrameReader reader;
+	std::atomic<bool> stopping = false;
+	int fd;
+	std::thread thread;
+
+public:
+	SlowClient(int port, std::size_t readBytesPerSecond, DeliveryStats &_stats)
+		: stats(_stats),
+		  fd(connectTcp(port, 4096))
+	{
+		if (fd < 0 || !sendAll(fd, UPGRADE_REQUEST)) {
+			return;
+		}
+
+		thread = std::thread([this, readBytesPerSecond] {
+			constexpr int READS_PER_SECOND = 20;
+			std::vector<char> chunk(std::max<std::size_t>(readBytesPerSecond / READS_PER_SECOND, 1));
+			auto nextRead = std::chrono::steady_clock::now();
+			while (!stopping.load(std::memory_order_relaxed)) {
+				const ssize_t received = recv(fd, chunk.data(), chunk.size(), 0);
+				if (received == 0) {
+					stats.disconnects.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				if (received > 0) {
+					reader.feed(chunk.data(), static_cast<std::size_t>(received),
+						    [this](unsigned int opCode, std::string_view payload) {
+							    if (opCode == TEXT_OPCODE) {
+								    stats.record(payload);
+							    }
+						    });
+				}
+				nextRead += std::chrono::milliseconds(1000 / READS_PER_SECOND);
+				std::this_thread::sleep_until(nextRead);
+			}
+		});
+	}
+
+	~SlowClient()
+	{
+		stopping = true;
+		if (thread.joinable()) {
+			thread.join();
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+};
+
+void report(const char *name, const DeliveryStats &stats, int clients, double seconds)
+{
+	const LatencyHistogram::Snapshot latency = stats.latencyNs.snapshot();
+	std::printf("%-13s %4d clients  p50 %8.3f ms  p99 %8.3f ms  %9.0f msg/s  %8.2f MiB/s  %llu disconnects\n",
+		    name, clients, static_cast<double>(latency.p50Ns) / 1e6, static_cast<double>(latency.p99Ns) / 1e6,
+		    static_cast<double>(stats.messages.load()) / seconds,
+		    static_cast<double>(stats.bytes.load()) / seconds / (1024.0 * 1024.0),
+		    static_cast<unsigned long long>(stats.disconnects.load()));
+}
+
+} // namespace
+
+TEST(WebSocketServerLoadTest, PublishToFastAndSlowClients)
+{
+	const LoadTestConfig loadTestConfig;
+	WebSocketServer::Config config;
+	config.port = loadTestConfig.port;
+
+	const std::int64_t rssBefore = getMaxRssBytes();
+	WebSocketServer server(config);
+	ASSERT_TRUE(waitForServer(config.port)) << "The server did not listen on port " << config.port;
+
+	DeliveryStats fastStats;
+	DeliveryStats slowStats;
+	std::uint64_t published = 0;
+	double elapsedSeconds = 0.0;
+	double loopCpuSeconds = 0.0;
+	{
+		FastClients fastClients(config.port, loadTestConfig.fastClients, fastStats);
+		std::vector<std::unique_ptr<SlowClient>> slowClients;
+		for (int i = 0; i < loadTestConfig.slowClients; i++) {
+			slowClients.push_back(std::make_unique<SlowClient>(
+				config.port, loadTestConfig.slowReadBytesPerSecond, slowStats));
+		}
+		// Let the clients upgrade before the first value, so that the measurement does not start with misses.
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		const std::string pad(loadTestConfig.payloadBytes, 'x');
+		const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / loadTestConfig.rateHz));
+		const double loopCpuBefore = scrapeLoopCpuSeconds(config.port);
+		const auto start = std::chrono::steady_clock::now();
+		const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+						 std::chrono::duration<double>(loadTestConfig.seconds));
+		for (auto next = start; next < end; next += period) {
+			std::this_thread::sleep_until(next);
+			server.publish(WebSocketServer::Topic::Scores, json{{"pad", pad}, {"sentNs", getNowNs()}});
+			published++;
+		}
+		// Let the last flush reach the fast clients.
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		loopCpuSeconds = scrapeLoopCpuSeconds(config.port) - loopCpuBefore;
+	}
+
+	const MemoryAccounting &accounting = MemoryAccounting::instance();
+	std::printf("published     %llu values at %.0f Hz, %zu bytes each\n",
+		    static_cast<unsigned long long>(published), loadTestConfig.rateHz, loadTestConfig.payloadBytes);
+	report("fast clients", fastStats, loadTestConfig.fastClients, elapsedSeconds);
+	report("slow clients", slowStats, loadTestConfig.slowClients, elapsedSeconds);
+	std::printf("server        %llu dropped  %llu slow disconnects  send buffers peak %lld KiB  "
+		    "RSS growth %lld KiB  loop CPU %.1f%%\n",
+		    static_cast<unsigned long long>(server.getDroppedMessageCount()),
+		    static_cast<unsigned long long>(server.getSlowClientDisconnectCount()),
+		    static_cast<long long>(
+			    accounting.getPeakBytes(MemoryAccounting::Category::WebSocketSendBuffers) / 1024),
+		    static_cast<long long>((getMaxRssBytes() - rssBefore) / 1024),
+		    loopCpuSeconds / elapsedSeconds * 100.0);
+
+	EXPECT_GT(published, 0u);
+	if (loadTestConfig.fastClients > 0) {
+		EXPECT_GT(fastStats.messages.load(), 0u);
+		EXPECT_EQ(fastStats.disconnects.load(), 0u);
+	}
+	// Slow clients are parked or disconnected by the policies, so the send buffers stay bounded.
+	EXPECT_LE(accounting.getPeakBytes(MemoryAccounting::Category::WebSocketSendBuffers),
+		  static_cast<std::int64_t>(loadTestConfig.fastClients + loadTestConfig.slowClients) *
+			  config.maxBackpressureBytes);
+}